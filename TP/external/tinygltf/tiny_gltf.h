@@ -1347,6 +1347,15 @@ class TinyGLTF {
   ///
   void SetImageLoader(LoadImageDataFunction LoadImageData, void *user_data);
 
+  ///
+  /// OM3D: Do not copy the GLB binary chunk into `Buffer::data`. The buffer
+  /// stored in the chunk is left empty and the caller reads the chunk in
+  /// place, the memory given to LoadBinaryFromMemory must outlive the model.
+  ///
+  void SetReferenceBinaryChunk(bool enabled) {
+    reference_bin_chunk_ = enabled;
+  }
+
   ///
   /// Unset(remove) callback of loading image data
   ///
@@ -1416,6 +1425,7 @@ class TinyGLTF {
   const unsigned char *bin_data_ = nullptr;
   size_t bin_size_ = 0;
   bool is_binary_ = false;
+  bool reference_bin_chunk_ = false;  // OM3D
 
   bool serialize_default_values_ = false;  ///< Serialize default values?
 
@@ -4018,7 +4028,8 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
                         FsCallbacks *fs, const std::string &basedir,
                         bool is_binary = false,
                         const unsigned char *bin_data = nullptr,
-                        size_t bin_size = 0) {
+                        size_t bin_size = 0,
+                        bool reference_bin = false) {
   size_t byteLength;
   if (!ParseUnsignedProperty(&byteLength, err, o, "byteLength", true,
                              "Buffer")) {
@@ -4029,8 +4040,21 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
   buffer->uri.clear();
   ParseStringProperty(&buffer->uri, err, o, "uri", false, "Buffer");
 
+  // OM3D: meshopt fallback buffers have no data, their views are decoded by
+  // the caller
+  bool meshopt_fallback = false;
+  if (buffer->uri.empty()) {
+    ExtensionMap extensions;
+    ParseExtensionsProperty(&extensions, err, o);
+    const auto meshopt = extensions.find("EXT_meshopt_compression");
+    meshopt_fallback = meshopt != extensions.end() &&
+                       meshopt->second.Has("fallback") &&
+                       meshopt->second.Get("fallback").IsBool() &&
+                       meshopt->second.Get("fallback").Get<bool>();
+  }
+
   // having an empty uri for a non embedded image should not be valid
-  if (!is_binary && buffer->uri.empty()) {
+  if (!is_binary && buffer->uri.empty() && !meshopt_fallback) {
     if (err) {
       (*err) += "'uri' is missing from non binary glTF file buffer.\n";
     }
@@ -4046,7 +4070,9 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
     }
   }
 
-  if (is_binary) {
+  if (meshopt_fallback) {
+    // OM3D: nothing to read
+  } else if (is_binary) {
     // Still binary glTF accepts external dataURI.
     if (!buffer->uri.empty()) {
       // First try embedded data URI.
@@ -4090,9 +4116,11 @@ static bool ParseBuffer(Buffer *buffer, std::string *err, const json &o,
         return false;
       }
 
-      // Read buffer data
-      buffer->data.resize(static_cast<size_t>(byteLength));
-      memcpy(&(buffer->data.at(0)), bin_data, static_cast<size_t>(byteLength));
+      // Read buffer data (OM3D: unless the caller reads the chunk in place)
+      if (!reference_bin) {
+        buffer->data.resize(static_cast<size_t>(byteLength));
+        memcpy(&(buffer->data.at(0)), bin_data, static_cast<size_t>(byteLength));
+      }
     }
 
   } else {
@@ -5643,7 +5671,8 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
       Buffer buffer;
       if (!ParseBuffer(&buffer, err, o,
                        store_original_json_for_extras_and_extensions_, &fs,
-                       base_dir, is_binary_, bin_data_, bin_size_)) {
+                       base_dir, is_binary_, bin_data_, bin_size_,
+                       reference_bin_chunk_)) {
         return false;
       }
 
@@ -5942,9 +5971,14 @@ bool TinyGLTF::LoadFromString(Model *model, std::string *err, std::string *warn,
           }
           return false;
         }
+        // OM3D: the buffer stored in the binary chunk may be referenced in place
+        const unsigned char *buffer_data =
+            (reference_bin_chunk_ && is_binary_ && buffer.uri.empty())
+                ? bin_data_
+                : buffer.data.data();
         bool ret = LoadImageData(
             &image, idx, err, warn, image.width, image.height,
-            &buffer.data[bufferView.byteOffset],
+            buffer_data + bufferView.byteOffset,
             static_cast<int>(bufferView.byteLength), load_image_user_data);
         if (!ret) {
           return false;
@@ -15,26 +15,50 @@ layout(location = 3) out vec3 out_position;
 layout(location = 4) out vec3 out_tangent;
 layout(location = 5) out vec3 out_bitangent;
 
+// The depth prepass and the G-buffer pass must compute the exact same depth
+invariant gl_Position;
+
 layout(binding = 0) uniform Data {
     FrameData frame;
 };
 
+#ifdef LIGHT_VOLUME
+layout(binding = 1) buffer PointLights {
+    PointLight point_lights[];
+};
+
+uniform uint light_index;
+#else
 layout(binding = 2) buffer Models {
     mat4 models[];
 };
+#endif
 
 void main() {
+#ifdef LIGHT_VOLUME
+    // Unit sphere scaled to the light radius
+    const PointLight light = point_lights[light_index];
+    const mat4 model = mat4(
+        vec4(light.radius, 0.0, 0.0, 0.0),
+        vec4(0.0, light.radius, 0.0, 0.0),
+        vec4(0.0, 0.0, light.radius, 0.0),
+        vec4(light.position, 1.0));
+#else
     mat4 model = models[gl_InstanceID];
+#endif
 
     const vec4 position = model * vec4(in_pos, 1.0);
 
+#ifndef DEPTH_ONLY
     out_normal = normalize(mat3(model) * in_normal);
     out_tangent = normalize(mat3(model) * in_tangent_bitangent_sign.xyz);
-    out_bitangent = cross(out_tangent, out_normal) * (in_tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
+    // glTF convention
+    out_bitangent = cross(out_normal, out_tangent) * (in_tangent_bitangent_sign.w > 0.0 ? 1.0 : -1.0);
 
     out_uv = in_uv;
     out_color = in_color;
     out_position = position.xyz;
+#endif
 
     gl_Position = frame.camera.view_proj * position;
 }
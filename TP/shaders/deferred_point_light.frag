@@ -2,9 +2,6 @@
 
 #include "utils.glsl"
 
-#define WINDOW_WIDTH 1600
-#define WINDOW_HEIGHT 900
-
 layout(location = 0) out vec3 out_color;
 
 layout(binding = 0) uniform sampler2D in_color;
@@ -21,10 +18,6 @@ layout(binding = 1) buffer PointLights {
 
 uniform uint light_index;
 
-vec3 remapNormal(vec3 normal) {
-    return normalize(normal * 2.0 - vec3(1.0));
-}
-
 vec3 unproject(vec2 uv, float depth, mat4 inv_viewproj) {
     const vec3 ndc = vec3(uv * 2.0 - vec2(1.0), depth);
     const vec4 p = inv_viewproj * vec4(ndc, 1.0);
@@ -34,11 +27,11 @@ vec3 unproject(vec2 uv, float depth, mat4 inv_viewproj) {
 void main() {
     vec3 color = texelFetch(in_color, ivec2(gl_FragCoord.xy), 0).xyz;
     
-    vec3 normal = remapNormal(texelFetch(in_normal, ivec2(gl_FragCoord.xy), 0).xyz);
-    vec2 uv = gl_FragCoord.xy / vec2(WINDOW_WIDTH, WINDOW_HEIGHT);
+    vec3 normal = decode_normal(texelFetch(in_normal, ivec2(gl_FragCoord.xy), 0).xy);
+    vec2 uv = gl_FragCoord.xy / frame.viewport_size;
     float depth = texelFetch(in_depth, ivec2(gl_FragCoord.xy), 0).x;
 
-    vec3 position = unproject(uv, depth, inverse(frame.camera.view_proj));
+    vec3 position = unproject(uv, depth, frame.camera.inv_view_proj);
     PointLight light = point_lights[light_index];
 
     vec3 pos2light = light.position - position;
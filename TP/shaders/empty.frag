@@ -0,0 +1,6 @@
+#version 450
+
+// Fragment shader for depth and stencil only passes
+
+void main() {
+}
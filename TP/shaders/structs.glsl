@@ -1,5 +1,6 @@
 struct CameraData {
     mat4 view_proj;
+    mat4 inv_view_proj;
 };
 
 struct FrameData {
@@ -10,6 +11,11 @@ struct FrameData {
 
     vec3 sun_color;
     float padding_1;
+
+    // Rendered area of the targets, in pixels
+    vec2 viewport_size;
+    // viewport_size / target size, to sample the targets with normalized coordinates
+    vec2 viewport_uv_scale;
 };
 
 struct PointLight {
@@ -19,3 +25,15 @@ struct PointLight {
     float padding_1;
 };
 
+
+#define EXPOSURE_HISTOGRAM_BINS 256
+
+struct ExposureData {
+    float exposure;
+    float average_luminance;
+    float padding_1;
+    float padding_2;
+
+    // Bin 0 counts black pixels, the others are spread over the log2 luminance range
+    uint histogram[EXPOSURE_HISTOGRAM_BINS];
+};
@@ -0,0 +1,48 @@
+#version 450
+
+#include "utils.glsl"
+
+// Exposure, tonemap and sRGB conversion, written directly to the presented framebuffer.
+// Also upscales the rendered viewport to the whole screen.
+
+layout(location = 0) out vec4 out_color;
+
+layout(location = 0) in vec2 in_uv;
+
+layout(binding = 0) uniform sampler2D in_color;
+
+layout(binding = 3) readonly buffer Exposure {
+    ExposureData exposure_data;
+};
+
+// Multiplies the auto exposure if enabled
+uniform float exposure = 1.0;
+uniform uint auto_exposure = 1;
+
+// Debug views are displayed as is
+uniform uint apply_tonemap = 1;
+
+uniform vec2 uv_scale = vec2(1.0);
+// Rendered part of in_color, in texels
+uniform uvec2 render_size = uvec2(0);
+
+float reinhard(float hdr) {
+    return hdr / (hdr + 1.0);
+}
+
+vec3 reinhard(vec3 x) {
+    return vec3(reinhard(x.x), reinhard(x.y), reinhard(x.z));
+}
+
+void main() {
+    // Bilinear filtering must not blend in the texels past the rendered viewport, left from other frames
+    const vec2 max_uv = (vec2(render_size) - 0.5) / vec2(textureSize(in_color, 0));
+    vec3 color = textureLod(in_color, min(in_uv * uv_scale, max_uv), 0.0).rgb;
+
+    if(apply_tonemap != 0) {
+        const float final_exposure = auto_exposure != 0 ? exposure * exposure_data.exposure : exposure;
+        color = reinhard(color * final_exposure);
+    }
+
+    out_color = vec4(linear_to_sRGB(saturate(color)), 1.0);
+}
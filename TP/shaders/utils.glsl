@@ -60,3 +60,22 @@ vec3 unpack_normal_map(vec2 normal) {
     return vec3(normal, 1.0 - sqrt(dot(normal, normal)));
 }
 
+vec2 sign_not_zero(vec2 v) {
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Octahedral normal encoding, remapped to [0, 1] to be stored in UNORM targets
+vec2 encode_normal(vec3 normal) {
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    const vec2 encoded = normal.z >= 0.0 ? normal.xy : (1.0 - abs(normal.yx)) * sign_not_zero(normal.xy);
+    return encoded * 0.5 + vec2(0.5);
+}
+
+vec3 decode_normal(vec2 encoded) {
+    encoded = encoded * 2.0 - vec2(1.0);
+    vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    const float t = saturate(-normal.z);
+    normal.xy -= t * sign_not_zero(normal.xy);
+    return normalize(normal);
+}
+
@@ -0,0 +1,225 @@
+#include "AllocationTracker.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#ifdef OS_LINUX
+#include <execinfo.h>
+#endif
+
+namespace OM3D {
+
+namespace {
+struct Counters {
+    std::atomic<u64> count = 0;
+    std::atomic<u64> bytes = 0;
+
+    // Only used by the thread calling allocation_tracking_new_frame
+    AllocationCounters frame_start;
+    AllocationCounters last_frame;
+
+    void add(size_t size) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    void new_frame() {
+        const AllocationCounters now = {count.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed)};
+        last_frame = {now.count - frame_start.count, now.bytes - frame_start.bytes};
+        frame_start = now;
+    }
+};
+}
+
+static constexpr u32 no_scope = u32(-1);
+
+static Counters total_counters;
+
+static Counters thread_counters[max_allocation_threads];
+static std::atomic<u32> thread_count = 0;
+
+static Counters scope_counters[max_allocation_scopes];
+static const char* scope_names[max_allocation_scopes] = {};
+static std::atomic<u32> scope_count = 0;
+static std::mutex scope_lock;
+
+static std::atomic<u64> frame_index = 0;
+static std::atomic<u64> strict_start_frame = 0;
+static std::atomic<StrictAllocationMode> strict_mode = StrictAllocationMode::Off;
+
+static thread_local u32 thread_index = no_scope;
+static thread_local u32 current_scope = no_scope;
+static thread_local bool in_tracker = false;
+
+static Counters& current_thread_counters() {
+    if(thread_index == no_scope) {
+        // Threads past the limit share the last slot
+        thread_index = std::min(thread_count.fetch_add(1), max_allocation_threads - 1);
+    }
+    return thread_counters[thread_index];
+}
+
+static void check_strict(size_t size) {
+    const StrictAllocationMode mode = strict_mode.load(std::memory_order_relaxed);
+    if(mode == StrictAllocationMode::Off || frame_index.load(std::memory_order_relaxed) < strict_start_frame.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    std::fprintf(stderr, "Allocation of %zu bytes in \"%s\" after warm-up\n", size, scope_names[current_scope]);
+#ifdef OS_LINUX
+    void* frames[32];
+    backtrace_symbols_fd(frames, backtrace(frames, 32), 2);
+#endif
+
+    if(mode == StrictAllocationMode::Abort) {
+        FATAL("Allocation in frame code");
+    }
+}
+
+[[maybe_unused]] static void record_allocation(size_t size) {
+    // Allocations made while reporting are not tracked
+    if(in_tracker) {
+        return;
+    }
+    in_tracker = true;
+
+    total_counters.add(size);
+    current_thread_counters().add(size);
+    if(current_scope != no_scope) {
+        scope_counters[current_scope].add(size);
+        check_strict(size);
+    }
+
+    in_tracker = false;
+}
+
+u32 register_allocation_scope(const char* name) {
+    const std::unique_lock lock(scope_lock);
+
+    const u32 count = scope_count.load();
+    for(u32 i = 0; i != count; ++i) {
+        if(std::strcmp(scope_names[i], name) == 0) {
+            return i;
+        }
+    }
+
+    ALWAYS_ASSERT(count < max_allocation_scopes, "Too many allocation scopes");
+    scope_names[count] = name;
+    scope_count.store(count + 1);
+    return count;
+}
+
+u32 current_allocation_scope() {
+    return current_scope;
+}
+
+AllocationScope::AllocationScope(u32 scope_id) : _parent(current_scope) {
+    current_scope = scope_id;
+}
+
+AllocationScope::~AllocationScope() {
+    current_scope = _parent;
+}
+
+void allocation_tracking_new_frame() {
+    frame_index.fetch_add(1, std::memory_order_relaxed);
+
+    total_counters.new_frame();
+    for(u32 i = 0; i != allocation_thread_count(); ++i) {
+        thread_counters[i].new_frame();
+    }
+    for(u32 i = 0; i != allocation_scope_count(); ++i) {
+        scope_counters[i].new_frame();
+    }
+}
+
+AllocationCounters last_frame_allocations() {
+    return total_counters.last_frame;
+}
+
+u32 allocation_scope_count() {
+    return scope_count.load();
+}
+
+const char* allocation_scope_name(u32 scope_id) {
+    DEBUG_ASSERT(scope_id < allocation_scope_count());
+    return scope_names[scope_id];
+}
+
+AllocationCounters last_frame_scope_allocations(u32 scope_id) {
+    DEBUG_ASSERT(scope_id < allocation_scope_count());
+    return scope_counters[scope_id].last_frame;
+}
+
+u32 allocation_thread_count() {
+    return std::min(thread_count.load(), max_allocation_threads);
+}
+
+AllocationCounters last_frame_thread_allocations(u32 thread_index) {
+    DEBUG_ASSERT(thread_index < allocation_thread_count());
+    return thread_counters[thread_index].last_frame;
+}
+
+void set_strict_allocation_mode(StrictAllocationMode mode, u32 warmup_frames) {
+    strict_start_frame = frame_index.load() + warmup_frames;
+    strict_mode = mode;
+}
+
+StrictAllocationMode strict_allocation_mode() {
+    return strict_mode;
+}
+
+}
+
+
+#ifdef ALLOCATION_TRACKING
+
+// The array, sized and nothrow forms of the standard library call these
+void* operator new(size_t size) {
+    OM3D::record_allocation(size);
+    if(void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    OM3D::record_allocation(size);
+    const size_t align = size_t(alignment);
+#ifdef OS_WIN
+    void* ptr = _aligned_malloc(size ? size : 1, align);
+#else
+    void* ptr = std::aligned_alloc(align, (std::max(size, size_t(1)) + align - 1) & ~(align - 1));
+#endif
+    if(ptr) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+#ifdef OS_WIN
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include <utils.h>
+
+// Counts heap allocations made through the global operator new, per thread and per scope.
+// Enabled with the TP_ALLOCATION_TRACKING CMake option, everything reports 0 otherwise.
+
+#ifdef ALLOCATION_TRACKING
+// Allocations are attributed to the innermost scope of the thread, and checked by the strict mode.
+// ThreadPool::parallel_for runs its pool threads in the scope of the caller, scheduled tasks have none.
+#define ALLOCATION_SCOPE(name) static const ::OM3D::u32 CREATE_UNIQUE_NAME_WITH_PREFIX(scope_id) = ::OM3D::register_allocation_scope(name); \
+    const ::OM3D::AllocationScope CREATE_UNIQUE_NAME_WITH_PREFIX(scope)(CREATE_UNIQUE_NAME_WITH_PREFIX(scope_id))
+#else
+#define ALLOCATION_SCOPE(name) do {} while(false)
+#endif
+
+namespace OM3D {
+
+#ifdef ALLOCATION_TRACKING
+static constexpr bool allocation_tracking_enabled = true;
+#else
+static constexpr bool allocation_tracking_enabled = false;
+#endif
+
+struct AllocationCounters {
+    u64 count = 0;
+    u64 bytes = 0;
+};
+
+enum class StrictAllocationMode {
+    Off,
+    // Print a stack trace for every allocation inside a scope
+    Log,
+    Abort,
+};
+
+// Scopes and threads are kept in fixed size tables, so tracking never allocates
+static constexpr u32 max_allocation_scopes = 64;
+static constexpr u32 max_allocation_threads = 64;
+
+u32 register_allocation_scope(const char* name);
+// Innermost scope of the calling thread, to enter it from another thread
+u32 current_allocation_scope();
+
+class AllocationScope : NonMovable {
+    public:
+        AllocationScope(u32 scope_id);
+        ~AllocationScope();
+
+    private:
+        u32 _parent;
+};
+
+// Marks the start of a frame: the counts of the frame that just ended become the last frame counts
+void allocation_tracking_new_frame();
+
+// Counts of the last complete frame
+AllocationCounters last_frame_allocations();
+u32 allocation_scope_count();
+const char* allocation_scope_name(u32 scope_id);
+AllocationCounters last_frame_scope_allocations(u32 scope_id);
+u32 allocation_thread_count();
+AllocationCounters last_frame_thread_allocations(u32 thread_index);
+
+// The strict mode starts checking after warmup_frames frames, once caches and pools are filled
+void set_strict_allocation_mode(StrictAllocationMode mode, u32 warmup_frames = 60);
+StrictAllocationMode strict_allocation_mode();
+
+}
+
+#endif // ALLOCATIONTRACKER_H
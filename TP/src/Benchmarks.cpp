@@ -0,0 +1,316 @@
+#include "Benchmarks.h"
+
+#include <OcclusionRasterizer.h>
+#include <HiZBuffer.h>
+#include <ObjectBatcher.h>
+#include <Camera.h>
+#include <Scene.h>
+#include <VertexDecoder.h>
+#include <TangentGenerator.h>
+
+#include <iostream>
+#include <random>
+
+namespace OM3D {
+
+// Runs func until at least min_time seconds elapsed, returns the average time of one run
+template<typename F>
+static double measure(F&& func, double min_time = 1.0) {
+    func(); // warm up
+
+    const double start = program_time();
+    u32 runs = 0;
+    do {
+        func();
+        ++runs;
+    } while(program_time() - start < min_time);
+
+    return (program_time() - start) / runs;
+}
+
+static OccluderMesh create_grid(u32 resolution, float size) {
+    OccluderMesh mesh;
+    for(u32 y = 0; y <= resolution; ++y) {
+        for(u32 x = 0; x <= resolution; ++x) {
+            const glm::vec2 pos = (glm::vec2(x, y) / float(resolution) - 0.5f) * size;
+            mesh.positions.emplace_back(pos.x, pos.y, 0.0f);
+        }
+    }
+    for(u32 y = 0; y != resolution; ++y) {
+        for(u32 x = 0; x != resolution; ++x) {
+            const u32 i = y * (resolution + 1) + x;
+            mesh.indices.insert(mesh.indices.end(), {i, i + 1, i + resolution + 2, i, i + resolution + 2, i + resolution + 1});
+        }
+    }
+    return mesh;
+}
+
+static void occlusion_benchmark() {
+    Camera camera;
+    camera.set_view(glm::lookAt(glm::vec3(0.0f, 0.0f, 20.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    // A wall of occluders in front of a cloud of small objects
+    const OccluderMesh wall = create_grid(64, 4.0f);
+    std::vector<glm::mat4> occluders;
+    for(int y = -4; y <= 4; ++y) {
+        for(int x = -6; x <= 6; ++x) {
+            occluders.push_back(glm::translate(glm::mat4(1.0f), glm::vec3(x * 4.5f, y * 4.5f, 0.0f)));
+        }
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<BoundingSphere> spheres(100000);
+    for(BoundingSphere& sphere : spheres) {
+        sphere.center = glm::vec3(dist(rng) * 40.0f, dist(rng) * 20.0f, -10.0f + dist(rng) * 30.0f);
+        sphere.radius = 0.1f + (dist(rng) + 1.0f);
+    }
+
+    OcclusionRasterizer rasterizer;
+
+    const double raster_time = measure([&] {
+        rasterizer.begin(camera.view_proj_matrix());
+        for(const glm::mat4& model : occluders) {
+            rasterizer.add_occluder(wall, model);
+        }
+        rasterizer.rasterize();
+    });
+
+    size_t occluded = 0;
+    const double test_time = measure([&] {
+        occluded = 0;
+        for(const BoundingSphere& sphere : spheres) {
+            occluded += rasterizer.is_occluded(sphere);
+        }
+    });
+
+    std::cout << "Occlusion rasterizer (" << rasterizer.size().x << "x" << rasterizer.size().y << ", " << ThreadPool::global().thread_count() << " threads)" << std::endl;
+    std::cout << "  " << rasterizer.triangle_count() << " triangles rasterized in " << raster_time * 1000.0 << "ms" << std::endl;
+    std::cout << "  " << spheres.size() << " spheres tested in " << test_time * 1000.0 << "ms (" << occluded << " occluded)" << std::endl;
+}
+
+static void scene_benchmark() {
+    Camera camera;
+    camera.set_view(glm::lookAt(glm::vec3(0.0f, 0.0f, 50.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    // Objects without mesh: only the storage, culling and batching are measured, nothing is drawn
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    Scene scene;
+    TransformHierarchy& hierarchy = scene.transform_hierarchy();
+    std::vector<TransformHierarchy::NodeId> nodes;
+    for(u32 i = 0; i != 100000; ++i) {
+        Transform transform;
+        transform.translation = glm::vec3(dist(rng), dist(rng), dist(rng)) * 100.0f;
+        nodes.push_back(hierarchy.add_node(transform));
+        scene.add_object(SceneObject(), nodes.back());
+    }
+    scene.update_transforms();
+
+    const Viewport viewport{glm::uvec2(1600, 900), glm::uvec2(1600, 900)};
+    size_t visible_count = 0;
+    const double cull_time = measure([&] {
+        begin_frame_allocations();
+        FrameVector<u32> visible;
+        scene.cull_objects(camera, viewport, {}, visible);
+        visible_count = visible.size();
+    });
+
+    begin_frame_allocations();
+    FrameVector<u32> culled;
+    scene.cull_objects(camera, viewport, {}, culled);
+    const std::vector<u32> visible(culled.begin(), culled.end());
+
+    const double batch_time = measure([&] {
+        begin_frame_allocations();
+        ObjectBatcher batcher;
+        for(const u32 i : visible) {
+            // Nothing was removed, object ids are the dense indices
+            const SceneObjectView obj = scene.get_object(i);
+            batcher.add_object(obj.material_handle(), obj.mesh_handle(), obj.transform());
+        }
+    });
+
+    const double update_time = measure([&] {
+        for(const TransformHierarchy::NodeId node : nodes) {
+            Transform transform = hierarchy.local_transform(node);
+            transform.translation.y += 0.01f;
+            hierarchy.set_local_transform(node, transform);
+        }
+        scene.update_transforms();
+    });
+
+    std::cout << "Scene (" << scene.object_count() << " objects)" << std::endl;
+    std::cout << "  culled in " << cull_time * 1000.0 << "ms (" << visible_count << " visible)" << std::endl;
+    std::cout << "  visible objects batched in " << batch_time * 1000.0 << "ms" << std::endl;
+    std::cout << "  all transforms updated in " << update_time * 1000.0 << "ms" << std::endl;
+}
+
+static void loader_benchmark() {
+    // Attributes in separate packed arrays, like most exporters write them
+    const size_t vertex_count = 1000000;
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<glm::vec3> positions(vertex_count);
+    std::vector<glm::vec3> normals(vertex_count);
+    std::vector<glm::vec2> uvs(vertex_count);
+    std::vector<glm::vec4> tangents(vertex_count);
+    for(size_t i = 0; i != vertex_count; ++i) {
+        positions[i] = glm::vec3(dist(rng), dist(rng), dist(rng)) * 100.0f;
+        normals[i] = glm::vec3(dist(rng), dist(rng), dist(rng));
+        uvs[i] = glm::vec2(dist(rng), dist(rng));
+        tangents[i] = glm::vec4(dist(rng), dist(rng), dist(rng), dist(rng) < 0.0f ? -1.0f : 1.0f);
+    }
+
+    const auto stream = [](const auto& values) {
+        using value_type = typename std::decay_t<decltype(values)>::value_type;
+        AttributeStream s;
+        s.data = reinterpret_cast<const u8*>(values.data());
+        s.stride = sizeof(value_type);
+        s.components = u32(value_type::length());
+        return s;
+    };
+
+    VertexStreams streams;
+    streams.position = stream(positions);
+    streams.normal = stream(normals);
+    streams.uv = stream(uvs);
+    streams.tangent_bitangent_sign = stream(tangents);
+
+    std::vector<Vertex> generic(vertex_count);
+    std::vector<Vertex> fast(vertex_count);
+
+    const double generic_time = measure([&] {
+        decode_vertices_generic(streams, generic);
+    });
+    const double fast_time = measure([&] {
+        decode_vertices(streams, fast);
+    });
+
+    float max_error = 0.0f;
+    for(size_t i = 0; i != vertex_count; ++i) {
+        max_error = std::max(max_error, glm::length(generic[i].position - fast[i].position));
+        max_error = std::max(max_error, glm::length(generic[i].normal - fast[i].normal));
+        max_error = std::max(max_error, glm::length(generic[i].uv - fast[i].uv));
+        max_error = std::max(max_error, glm::length(generic[i].tangent_bitangent_sign - fast[i].tangent_bitangent_sign));
+    }
+
+    std::cout << "Vertex decoding (" << vertex_count << " vertices, position + normal + uv + tangent)" << std::endl;
+    std::cout << "  generic: " << vertex_count / generic_time * 1e-6 << "M vertices/s" << std::endl;
+    std::cout << "  single pass: " << vertex_count / fast_time * 1e-6 << "M vertices/s (max difference " << max_error << ")" << std::endl;
+}
+
+static void tangent_benchmark() {
+    // Flat grid facing +Z, with UVs mirrored on the right half (u decreases toward +X)
+    const u32 resolution = 1024;
+    const OccluderMesh grid = create_grid(resolution, 2.0f);
+
+    std::vector<Vertex> vertices(grid.positions.size());
+    for(size_t i = 0; i != vertices.size(); ++i) {
+        const glm::vec3 pos = grid.positions[i];
+        vertices[i].position = pos;
+        vertices[i].normal = glm::vec3(0.0f, 0.0f, 1.0f);
+        vertices[i].uv = glm::vec2(std::abs(pos.x), pos.y);
+    }
+
+    const double time = measure([&] {
+        generate_tangents(vertices, grid.indices);
+    });
+
+    // Vertices on the mirror line get both sides averaged, skip them
+    u32 wrong = 0;
+    for(const Vertex& vertex : vertices) {
+        if(std::abs(vertex.position.x) < 1e-4f) {
+            continue;
+        }
+        // v increases toward +Y, so the glTF bitangent (cross(normal, tangent) * w) has to point toward -Y
+        const glm::vec4 expected = vertex.position.x < 0.0f ? glm::vec4(-1.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(1.0f, 0.0f, 0.0f, -1.0f);
+        wrong += glm::length(vertex.tangent_bitangent_sign - expected) > 1e-3f;
+    }
+
+    const size_t triangle_count = grid.indices.size() / 3;
+    std::cout << "Tangent generation (" << triangle_count << " triangles, " << vertices.size() << " vertices)" << std::endl;
+    std::cout << "  " << triangle_count / time * 1e-6 << "M triangles/s (" << wrong << " wrong tangents)" << std::endl;
+}
+
+static void hiz_benchmark() {
+    // Odd sizes: the last texel of every level also covers the left over row/column
+    const glm::uvec2 size(91, 45);
+
+    // A wall at 0.9 with a few holes to the far plane
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+    std::vector<float> depth(size.x * size.y);
+    for(float& d : depth) {
+        d = dist(rng) < 0.02f ? 0.0f : 0.9f;
+    }
+
+    HiZLevels levels;
+    Span<float> first_level = levels.reset(size, 0);
+    std::copy(depth.begin(), depth.end(), first_level.data());
+    levels.build();
+
+    std::vector<ScreenBounds> bounds(100000);
+    for(ScreenBounds& b : bounds) {
+        const glm::vec2 a(dist(rng), dist(rng));
+        const glm::vec2 extent = glm::vec2(dist(rng), dist(rng)) * (dist(rng) < 0.5f ? 0.1f : 0.5f);
+        b.min_uv = a;
+        b.max_uv = glm::min(a + extent, glm::vec2(1.0f));
+        b.nearest_depth = 0.5f;
+    }
+
+    size_t occluded = 0;
+    const double time = measure([&] {
+        occluded = 0;
+        for(const ScreenBounds& b : bounds) {
+            occluded += levels.is_occluded(b.min_uv, b.max_uv, b.nearest_depth);
+        }
+    });
+
+    // Occluded bounds must not cover any hole of the depth buffer
+    u32 wrong = 0;
+    for(const ScreenBounds& b : bounds) {
+        if(!levels.is_occluded(b.min_uv, b.max_uv, b.nearest_depth)) {
+            continue;
+        }
+        const glm::uvec2 first = glm::min(glm::uvec2(b.min_uv * glm::vec2(size)), size - 1u);
+        const glm::uvec2 last = glm::min(glm::uvec2(b.max_uv * glm::vec2(size)), size - 1u);
+        bool visible = false;
+        for(u32 y = first.y; y <= last.y; ++y) {
+            for(u32 x = first.x; x <= last.x; ++x) {
+                visible |= depth[y * size.x + x] <= b.nearest_depth;
+            }
+        }
+        wrong += visible;
+    }
+
+    std::cout << "Hi-Z pyramid (" << size.x << "x" << size.y << ")" << std::endl;
+    std::cout << "  " << bounds.size() << " bounds tested in " << time * 1000.0 << "ms (" << occluded << " occluded, " << wrong << " wrongly occluded)" << std::endl;
+}
+
+bool run_benchmark(std::string_view name) {
+    if(name == "occlusion") {
+        occlusion_benchmark();
+        return true;
+    }
+    if(name == "scene") {
+        scene_benchmark();
+        return true;
+    }
+    if(name == "loader") {
+        loader_benchmark();
+        return true;
+    }
+    if(name == "tangents") {
+        tangent_benchmark();
+        return true;
+    }
+    if(name == "hiz") {
+        hiz_benchmark();
+        return true;
+    }
+
+    return false;
+}
+
+}
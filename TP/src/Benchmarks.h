@@ -0,0 +1,13 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <string_view>
+
+namespace OM3D {
+
+// CPU only benchmarks, they do not need a GL context. Returns false if the name is unknown.
+bool run_benchmark(std::string_view name);
+
+}
+
+#endif // BENCHMARKS_H
@@ -32,6 +32,12 @@ void ByteBuffer::bind(BufferUsage usage, u32 index) const {
     glBindBufferBase(buffer_usage_to_gl(usage), index, _handle.get());
 }
 
+void ByteBuffer::bind(BufferUsage usage, u32 index, size_t offset, size_t size) const {
+    ALWAYS_ASSERT(usage == BufferUsage::Uniform || usage == BufferUsage::Storage, "Index bind is only available for uniform and storage buffers");
+    DEBUG_ASSERT(offset + size <= _size);
+    glBindBufferRange(buffer_usage_to_gl(usage), index, _handle.get(), offset, size);
+}
+
 size_t ByteBuffer::byte_size() const {
     return _size;
 }
@@ -18,6 +18,7 @@ class ByteBuffer : NonCopyable {
 
         void bind(BufferUsage usage) const;
         void bind(BufferUsage usage, u32 index) const;
+        void bind(BufferUsage usage, u32 index, size_t offset, size_t size) const;
 
         size_t byte_size() const;
 
@@ -78,6 +78,27 @@ void Camera::update() {
     _view_proj = _projection * _view;
 }
 
+Result<ScreenBounds> project_box(const glm::mat4& view_proj, const glm::vec3& box_min, const glm::vec3& box_max) {
+    ScreenBounds bounds = {glm::vec2(1.0f), glm::vec2(0.0f), 0.0f};
+    for(u32 i = 0; i != 8; ++i) {
+        const glm::vec3 corner((i & 1) ? box_max.x : box_min.x, (i & 2) ? box_max.y : box_min.y, (i & 4) ? box_max.z : box_min.z);
+        const glm::vec4 proj = view_proj * glm::vec4(corner, 1.0f);
+        if(proj.w <= 0.0f) {
+            return {false, {}};
+        }
+
+        const glm::vec3 ndc = glm::vec3(proj) / proj.w;
+        const glm::vec2 uv = glm::vec2(ndc) * 0.5f + 0.5f;
+        bounds.min_uv = glm::min(bounds.min_uv, uv);
+        bounds.max_uv = glm::max(bounds.max_uv, uv);
+        bounds.nearest_depth = std::max(bounds.nearest_depth, ndc.z);
+    }
+
+    bounds.min_uv = glm::clamp(bounds.min_uv, glm::vec2(0.0f), glm::vec2(1.0f));
+    bounds.max_uv = glm::clamp(bounds.max_uv, glm::vec2(0.0f), glm::vec2(1.0f));
+    return {true, bounds};
+}
+
 Frustum Camera::build_frustum() const {
     const glm::vec3 camera_forward = forward();
     const glm::vec3 camera_up = up();
@@ -16,6 +16,17 @@ struct Frustum {
     glm::vec3 _left_normal;
 };
 
+struct ScreenBounds {
+    glm::vec2 min_uv;
+    glm::vec2 max_uv;
+
+    // We use reverse-Z, so this is the biggest depth
+    float nearest_depth;
+};
+
+// Screen space bounds of a world space box, fails if the box crosses the camera plane
+Result<ScreenBounds> project_box(const glm::mat4& view_proj, const glm::vec3& box_min, const glm::vec3& box_max);
+
 
 class Camera {
     public:
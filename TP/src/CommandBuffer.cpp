@@ -0,0 +1,264 @@
+#include "CommandBuffer.h"
+
+#include <Material.h>
+#include <StaticMesh.h>
+#include <AllocationTracker.h>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace OM3D {
+
+// Key layout, from the most significant bits
+static constexpr u32 pass_bits = 4;
+static constexpr u32 program_bits = 12;
+static constexpr u32 texture_set_bits = 16;
+static constexpr u32 depth_bits = 12;
+static constexpr u32 mesh_bits = 20;
+static_assert(pass_bits + program_bits + texture_set_bits + depth_bits + mesh_bits == 64);
+
+// Top bits of the float representation, which is monotonic for positive values.
+// With 12 bits, a bucket covers about 1/8th of its distance to the camera.
+static u32 quantize_depth(float depth) {
+    const float clamped = std::max(depth, 0.0f);
+    u32 bits = 0;
+    std::memcpy(&bits, &clamped, sizeof(bits));
+    return bits >> (32 - depth_bits);
+}
+
+u64 draw_sort_key(DrawPass pass, const Material& material, u32 mesh_id, float depth) {
+    const u64 depth_mask = (u64(1) << depth_bits) - 1;
+    u64 depth_key = quantize_depth(depth);
+    if(pass == DrawPass::Transparent) {
+        depth_key = ~depth_key & depth_mask;
+    }
+
+    // Ids use their top bits: program and texture ids are hashes
+    u64 key = u64(pass);
+    key = (key << program_bits) | (material.program_id() >> (32 - program_bits));
+    key = (key << texture_set_bits) | (material.texture_set_id() >> (32 - texture_set_bits));
+    key = (key << depth_bits) | depth_key;
+    key = (key << mesh_bits) | (mesh_id & ((u64(1) << mesh_bits) - 1));
+    return key;
+}
+
+Command& CommandBuffer::push(u64 key, CommandType type) {
+    Command& command = _commands.emplace_back();
+    command.key = key;
+    command.type = type;
+    return command;
+}
+
+void CommandBuffer::draw_mesh(u64 key, const Material* material, const StaticMesh* mesh, u32 lod, Span<const glm::mat4> models, DrawMode mode) {
+    Command& command = push(key, CommandType::DrawMesh);
+    command.draw_mesh = {material, mesh, lod, u32(_models.size()), u32(models.size()), mode};
+    _models.insert(_models.end(), models.begin(), models.end());
+}
+
+void CommandBuffer::draw_fullscreen(u64 key, const Material* material) {
+    push(key, CommandType::DrawFullscreen).draw_fullscreen = {material};
+}
+
+void CommandBuffer::draw_indexed(u64 key, const Material* material, u32 index_count, u32 first_index, i32 base_vertex, u32 index_size) {
+    DEBUG_ASSERT(index_size == 2 || index_size == 4);
+    push(key, CommandType::DrawIndexed).draw_indexed = {material, index_count, first_index, base_vertex, index_size};
+}
+
+void CommandBuffer::set_uniform(u64 key, Material* material, u32 name_hash, u32 value) {
+    push(key, CommandType::SetUniform).set_uniform = {material, name_hash, value};
+}
+
+void CommandBuffer::bind_texture(u64 key, const Texture* texture, u32 index) {
+    push(key, CommandType::BindTexture).bind_texture = {texture, index};
+}
+
+void CommandBuffer::set_scissor(u64 key, i32 x, i32 y, i32 width, i32 height) {
+    push(key, CommandType::SetScissor).set_scissor = {x, y, width, height};
+}
+
+size_t CommandBuffer::size() const {
+    return _commands.size();
+}
+
+Span<const Command> CommandBuffer::commands() const {
+    return _commands;
+}
+
+Span<const glm::mat4> CommandBuffer::models() const {
+    return _models;
+}
+
+void CommandBuffer::submit() const {
+    const CommandBuffer* buffer = this;
+    submit_commands(Span<const CommandBuffer* const>(&buffer, 1));
+}
+
+
+// Model ranges are bound with glBindBufferRange, which needs aligned offsets
+static size_t storage_offset_alignment() {
+    static const size_t alignment = [] {
+        GLint value = 0;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &value);
+        return size_t(std::max(value, 1));
+    }();
+    return alignment;
+}
+
+// Stable LSD radix sort on the keys, 8 bits at a time. Digits that are the same for every key are skipped.
+template<typename T>
+static void radix_sort(FrameVector<T>& entries) {
+    constexpr u32 digit_count = sizeof(u64);
+    u32 histograms[digit_count][256] = {};
+    for(const T& entry : entries) {
+        for(u32 d = 0; d != digit_count; ++d) {
+            ++histograms[d][(entry.key >> (d * 8)) & 0xFF];
+        }
+    }
+
+    FrameVector<T> sorted(entries.size());
+    for(u32 d = 0; d != digit_count; ++d) {
+        u32* histogram = histograms[d];
+        if(histogram[(entries[0].key >> (d * 8)) & 0xFF] == entries.size()) {
+            continue;
+        }
+
+        u32 offset = 0;
+        for(u32 i = 0; i != 256; ++i) {
+            const u32 count = histogram[i];
+            histogram[i] = offset;
+            offset += count;
+        }
+
+        for(const T& entry : entries) {
+            sorted[histogram[(entry.key >> (d * 8)) & 0xFF]++] = entry;
+        }
+        entries.swap(sorted);
+    }
+}
+
+void submit_commands(Span<const CommandBuffer* const> buffers) {
+    ALLOCATION_SCOPE("submit_commands");
+
+    struct Entry {
+        u64 key;
+        const Command* command;
+        u32 buffer;
+    };
+
+    // Entries are in recording order: the sort being stable keeps it for equal keys
+    FrameVector<Entry> entries;
+    {
+        size_t count = 0;
+        for(const CommandBuffer* buffer : buffers) {
+            count += buffer->size();
+        }
+        entries.reserve(count);
+    }
+    for(u32 b = 0; b != buffers.size(); ++b) {
+        for(const Command& command : buffers[b]->commands()) {
+            entries.push_back({command.key, &command, b});
+        }
+    }
+
+    if(entries.empty()) {
+        return;
+    }
+
+    radix_sort(entries);
+
+    // Every model goes in a single buffer, in submission order
+    const size_t alignment = storage_offset_alignment();
+    FrameVector<size_t> model_offsets(entries.size(), 0);
+    size_t model_bytes = 0;
+    for(size_t i = 0; i != entries.size(); ++i) {
+        if(entries[i].command->type == CommandType::DrawMesh && entries[i].command->draw_mesh.model_count) {
+            model_bytes = (model_bytes + alignment - 1) / alignment * alignment;
+            model_offsets[i] = model_bytes;
+            model_bytes += entries[i].command->draw_mesh.model_count * sizeof(glm::mat4);
+        }
+    }
+
+    ByteBuffer model_buffer;
+    if(model_bytes) {
+        model_buffer = ByteBuffer(nullptr, model_bytes);
+        auto mapping = model_buffer.map_bytes(AccessType::WriteOnly);
+        for(size_t i = 0; i != entries.size(); ++i) {
+            if(entries[i].command->type == CommandType::DrawMesh && entries[i].command->draw_mesh.model_count) {
+                const DrawMeshCommand& draw = entries[i].command->draw_mesh;
+                const glm::mat4* models = buffers[entries[i].buffer]->models().data() + draw.first_model;
+                std::copy_n(models, draw.model_count, reinterpret_cast<glm::mat4*>(mapping.data() + model_offsets[i]));
+            }
+        }
+    }
+
+    // Materials only set the state that differs from the previous one
+    const Material* bound_material = nullptr;
+    bool depth_equal = false;
+    const auto bind_material = [&](const Material* material, bool equal = false) {
+        if(material == bound_material && equal == depth_equal) {
+            return;
+        }
+
+        // Leaving the override, the depth state does not match the previous material
+        material->bind(depth_equal && !equal ? nullptr : bound_material);
+        if(equal) {
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+
+        bound_material = material;
+        depth_equal = equal;
+    };
+
+    for(size_t i = 0; i != entries.size(); ++i) {
+        const Command& command = *entries[i].command;
+        switch(command.type) {
+            case CommandType::DrawMesh: {
+                const DrawMeshCommand& draw = command.draw_mesh;
+                bind_material(draw.material, draw.mode == DrawMode::DepthEqual);
+                if(draw.model_count) {
+                    model_buffer.bind(BufferUsage::Storage, 2, model_offsets[i], draw.model_count * sizeof(glm::mat4));
+                }
+                const int instances = int(std::max(draw.model_count, 1u));
+                if(draw.mode == DrawMode::DepthOnly) {
+                    draw.mesh->draw_positions(instances, draw.lod);
+                } else {
+                    draw.mesh->draw(instances, draw.lod);
+                }
+            } break;
+
+            case CommandType::DrawFullscreen:
+                bind_material(command.draw_fullscreen.material);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            break;
+
+            case CommandType::DrawIndexed: {
+                const DrawIndexedCommand& draw = command.draw_indexed;
+                bind_material(draw.material);
+                const GLenum index_type = draw.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+                glDrawElementsBaseVertex(GL_TRIANGLES, int(draw.index_count), index_type, reinterpret_cast<void*>(size_t(draw.first_index) * draw.index_size), draw.base_vertex);
+            } break;
+
+            case CommandType::SetUniform:
+                command.set_uniform.material->set_uniform(command.set_uniform.name_hash, command.set_uniform.value);
+            break;
+
+            case CommandType::BindTexture:
+                command.bind_texture.texture->bind(command.bind_texture.index);
+                if(bound_material && bound_material->has_texture(command.bind_texture.index)) {
+                    // The material texture needs to be bound again
+                    bound_material = nullptr;
+                }
+            break;
+
+            case CommandType::SetScissor:
+                glScissor(command.set_scissor.x, command.set_scissor.y, command.set_scissor.width, command.set_scissor.height);
+            break;
+        }
+    }
+}
+
+}
@@ -0,0 +1,135 @@
+#ifndef COMMANDBUFFER_H
+#define COMMANDBUFFER_H
+
+#include <FrameAllocator.h>
+
+#include <glm/mat4x4.hpp>
+
+namespace OM3D {
+
+class Material;
+class StaticMesh;
+class Texture;
+
+enum class CommandType : u8 {
+    // Instanced mesh, the models come from the command buffer
+    DrawMesh,
+    // Single triangle covering the screen, without vertex buffer
+    DrawFullscreen,
+    // From the vertex and index buffers bound before submission
+    DrawIndexed,
+    SetUniform,
+    BindTexture,
+    SetScissor,
+};
+
+enum class DrawMode : u8 {
+    Standard,
+    // Only the mesh positions, see StaticMesh::draw_positions
+    DepthOnly,
+    // Replaces the material depth state to shade only the surfaces left by a depth prepass
+    DepthEqual,
+};
+
+// Draws bind their material, unless it is already bound.
+// Meshes without models are drawn once, without binding the model buffer.
+struct DrawMeshCommand {
+    const Material* material;
+    const StaticMesh* mesh;
+    u32 lod;
+    u32 first_model;
+    u32 model_count;
+    DrawMode mode;
+};
+
+struct DrawFullscreenCommand {
+    const Material* material;
+};
+
+struct DrawIndexedCommand {
+    const Material* material;
+    u32 index_count;
+    u32 first_index;
+    i32 base_vertex;
+    u32 index_size;
+};
+
+struct SetUniformCommand {
+    Material* material;
+    u32 name_hash;
+    u32 value;
+};
+
+struct BindTextureCommand {
+    const Texture* texture;
+    u32 index;
+};
+
+struct SetScissorCommand {
+    i32 x;
+    i32 y;
+    i32 width;
+    i32 height;
+};
+
+enum class DrawPass : u8 {
+    Opaque,
+    // Drawn after opaque geometry, back to front
+    Transparent,
+};
+
+// Draw keys sort by pass, then program, textures, coarse view depth (front to back for opaque draws) and mesh.
+// Consecutive draws then mostly share their program and textures, which bind only when they change.
+u64 draw_sort_key(DrawPass pass, const Material& material, u32 mesh_id, float depth);
+
+// POD packet, only the member matching the type is valid
+struct Command {
+    u64 key;
+    CommandType type;
+
+    union {
+        DrawMeshCommand draw_mesh;
+        DrawFullscreenCommand draw_fullscreen;
+        DrawIndexedCommand draw_indexed;
+        SetUniformCommand set_uniform;
+        BindTextureCommand bind_texture;
+        SetScissorCommand set_scissor;
+    };
+};
+
+// Draws and state changes recorded without any GL call, so any thread can record.
+// Storage comes from the frame allocator of the thread that creates the buffer:
+// a buffer is recorded by a single thread, and submitted in the same frame.
+class CommandBuffer : NonCopyable {
+    public:
+        CommandBuffer() = default;
+        CommandBuffer(CommandBuffer&&) = default;
+
+        void draw_mesh(u64 key, const Material* material, const StaticMesh* mesh, u32 lod = 0, Span<const glm::mat4> models = {}, DrawMode mode = DrawMode::Standard);
+        void draw_fullscreen(u64 key, const Material* material);
+        void draw_indexed(u64 key, const Material* material, u32 index_count, u32 first_index, i32 base_vertex, u32 index_size);
+        void set_uniform(u64 key, Material* material, u32 name_hash, u32 value);
+        void bind_texture(u64 key, const Texture* texture, u32 index);
+        void set_scissor(u64 key, i32 x, i32 y, i32 width, i32 height);
+
+        size_t size() const;
+        Span<const Command> commands() const;
+        Span<const glm::mat4> models() const;
+
+        // GL thread only
+        void submit() const;
+
+    private:
+        Command& push(u64 key, CommandType type);
+
+        FrameVector<Command> _commands;
+        FrameVector<glm::mat4> _models;
+};
+
+// Executes the commands of every buffer in key order, GL thread only.
+// Commands with the same key keep their order, and buffers are taken in order.
+void submit_commands(Span<const CommandBuffer* const> buffers);
+
+}
+
+#endif // COMMANDBUFFER_H
@@ -0,0 +1,90 @@
+#include "DepthPrepass.h"
+
+#include <glad/glad.h>
+
+namespace OM3D {
+
+// The prepass costs a second geometry pass: only enable it when it saves a good share of the shading.
+// Different thresholds to switch on and off, to avoid toggling every frame around a single value.
+static constexpr float enable_overdraw = 1.6f;
+static constexpr float disable_overdraw = 1.3f;
+
+DepthPrepass::DepthPrepass() : _material(Material::depth_only_material()) {
+    glCreateQueries(GL_SAMPLES_PASSED, query_count, _queries.data());
+}
+
+DepthPrepass::~DepthPrepass() {
+    glDeleteQueries(query_count, _queries.data());
+}
+
+void DepthPrepass::begin_measure() {
+    if(_pending_queries == query_count) {
+        // Every query is still in flight, skip measuring this frame
+        return;
+    }
+
+    glBeginQuery(GL_SAMPLES_PASSED, _queries[_next_query]);
+    _measuring = true;
+}
+
+void DepthPrepass::end_measure(const glm::uvec2& render_size) {
+    if(_measuring) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        _query_pixels[_next_query] = u64(render_size.x) * render_size.y;
+        _next_query = (_next_query + 1) % query_count;
+        ++_pending_queries;
+        _measuring = false;
+    }
+
+    if(!_pending_queries) {
+        return;
+    }
+
+    // Collect the oldest query if it is done
+    const u32 oldest_index = (_next_query + query_count - _pending_queries) % query_count;
+    const u32 oldest = _queries[oldest_index];
+
+    i32 available = 0;
+    glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available) {
+        return;
+    }
+
+    u64 samples = 0;
+    glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &samples);
+    --_pending_queries;
+
+    if(const u64 pixels = _query_pixels[oldest_index]) {
+        _overdraw = float(double(samples) / double(pixels));
+    }
+
+    // Same draws in the same order with and without the prepass, so switching does not change the measure
+    _auto_enabled = _overdraw > (_auto_enabled ? disable_overdraw : enable_overdraw);
+}
+
+bool DepthPrepass::is_enabled() const {
+    switch(_mode) {
+        case DepthPrepassMode::Always:
+            return true;
+
+        case DepthPrepassMode::Never:
+            return false;
+
+        default:
+            return _auto_enabled;
+    }
+}
+
+const Material& DepthPrepass::material() const {
+    return _material;
+}
+
+float DepthPrepass::overdraw() const {
+    return _overdraw;
+}
+
+DepthPrepassMode& DepthPrepass::mode() {
+    return _mode;
+}
+
+}
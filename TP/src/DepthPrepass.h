@@ -0,0 +1,61 @@
+#ifndef DEPTHPREPASS_H
+#define DEPTHPREPASS_H
+
+#include <Material.h>
+
+#include <glm/vec2.hpp>
+
+#include <array>
+
+namespace OM3D {
+
+enum class DepthPrepassMode {
+    // From the measured overdraw
+    Auto,
+    Always,
+    Never,
+};
+
+// Draws the opaque geometry depth before the G-buffer pass, which then only shades the visible surfaces.
+// This pays off when many fragments get overdrawn: overdraw is measured with samples passed queries on the
+// opaque draws of the pass that first tests the scene depth, read a few frames late without stalling.
+// The prepass draws in the G-buffer order, so the measure does not depend on whether it is enabled.
+class DepthPrepass : NonMovable {
+    public:
+        DepthPrepass();
+        ~DepthPrepass();
+
+        // Surround the first depth tested opaque draws: the prepass when it is enabled, the G-buffer pass otherwise
+        void begin_measure();
+        void end_measure(const glm::uvec2& render_size);
+
+        bool is_enabled() const;
+
+        // For the draws of the prepass
+        const Material& material() const;
+
+        // Fragments passing the depth test per pixel, as last measured
+        float overdraw() const;
+
+        DepthPrepassMode& mode();
+
+    private:
+        static constexpr u32 query_count = 4;
+
+        Material _material;
+        DepthPrepassMode _mode = DepthPrepassMode::Auto;
+        // Choice of the Auto mode
+        bool _auto_enabled = false;
+
+        std::array<u32, query_count> _queries = {};
+        std::array<u64, query_count> _query_pixels = {};
+        u32 _next_query = 0;
+        u32 _pending_queries = 0;
+        bool _measuring = false;
+
+        float _overdraw = 0.0f;
+};
+
+}
+
+#endif // DEPTHPREPASS_H
@@ -0,0 +1,96 @@
+#include "DynamicResolution.h"
+
+#include <glad/glad.h>
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace OM3D {
+
+// Don't react to small variations of the frame time
+static constexpr float scale_tolerance = 0.05f;
+
+// Fraction of the error corrected every measurement, to avoid oscillations
+static constexpr float scale_damping = 0.25f;
+
+DynamicResolution::DynamicResolution(const glm::uvec2& max_size) : _max_size(max_size) {
+    glCreateQueries(GL_TIME_ELAPSED, query_count, _queries.data());
+}
+
+DynamicResolution::~DynamicResolution() {
+    glDeleteQueries(query_count, _queries.data());
+}
+
+void DynamicResolution::begin_frame() {
+    if(_pending_queries == query_count) {
+        // Every query is still in flight, skip measuring this frame
+        return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, _queries[_next_query]);
+}
+
+void DynamicResolution::end_frame() {
+    if(_pending_queries != query_count) {
+        glEndQuery(GL_TIME_ELAPSED);
+        _next_query = (_next_query + 1) % query_count;
+        ++_pending_queries;
+    }
+
+    // Collect the oldest query if it is done
+    const u32 oldest = _queries[(_next_query + query_count - _pending_queries) % query_count];
+
+    i32 available = 0;
+    glGetQueryObjectiv(oldest, GL_QUERY_RESULT_AVAILABLE, &available);
+    if(!available) {
+        return;
+    }
+
+    u64 elapsed_ns = 0;
+    glGetQueryObjectui64v(oldest, GL_QUERY_RESULT, &elapsed_ns);
+    --_pending_queries;
+
+    _gpu_frame_time = float(double(elapsed_ns) * 1e-6);
+    update_scale(_gpu_frame_time);
+}
+
+void DynamicResolution::update_scale(float frame_time) {
+    if(!_settings.enabled) {
+        _scale = _settings.max_scale;
+        return;
+    }
+
+    if(frame_time <= 0.0f) {
+        return;
+    }
+
+    // Cost is roughly proportional to the pixel count, so to the square of the scale
+    const float ratio = _settings.target_frame_time / frame_time;
+    if(std::abs(ratio - 1.0f) > scale_tolerance) {
+        const float target_scale = _scale * std::sqrt(ratio);
+        _scale += (target_scale - _scale) * scale_damping;
+    }
+
+    _scale = std::clamp(_scale, _settings.min_scale, _settings.max_scale);
+}
+
+glm::uvec2 DynamicResolution::render_size() const {
+    const glm::uvec2 size = glm::uvec2(glm::vec2(_max_size) * _scale + 0.5f);
+    return glm::clamp(size, glm::uvec2(1), _max_size);
+}
+
+float DynamicResolution::scale() const {
+    return _scale;
+}
+
+float DynamicResolution::gpu_frame_time() const {
+    return _gpu_frame_time;
+}
+
+DynamicResolutionSettings& DynamicResolution::settings() {
+    return _settings;
+}
+
+}
@@ -0,0 +1,59 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <graphics.h>
+
+#include <glm/vec2.hpp>
+
+#include <array>
+
+namespace OM3D {
+
+struct DynamicResolutionSettings {
+    bool enabled = true;
+
+    // GPU time of the scaled passes to aim for, in ms
+    float target_frame_time = 12.0f;
+
+    float min_scale = 0.5f;
+    float max_scale = 1.0f;
+};
+
+// Scales the internal render resolution to keep the GPU frame time close to a target.
+// GPU time is measured with timer queries that are read a few frames late, without stalling.
+class DynamicResolution : NonMovable {
+    public:
+        DynamicResolution(const glm::uvec2& max_size);
+        ~DynamicResolution();
+
+        // Surround the GPU work that scales with the resolution
+        void begin_frame();
+        void end_frame();
+
+        glm::uvec2 render_size() const;
+        float scale() const;
+
+        // Last measured GPU time, in ms
+        float gpu_frame_time() const;
+
+        DynamicResolutionSettings& settings();
+
+    private:
+        void update_scale(float frame_time);
+
+        static constexpr u32 query_count = 4;
+
+        DynamicResolutionSettings _settings;
+        glm::uvec2 _max_size = {};
+        float _scale = 1.0f;
+
+        std::array<u32, query_count> _queries = {};
+        u32 _next_query = 0;
+        u32 _pending_queries = 0;
+
+        float _gpu_frame_time = 0.0f;
+};
+
+}
+
+#endif // DYNAMICRESOLUTION_H
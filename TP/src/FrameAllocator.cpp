@@ -0,0 +1,73 @@
+#include "FrameAllocator.h"
+
+#include <atomic>
+
+namespace OM3D {
+
+static std::atomic<u64> frame_index = 0;
+
+LinearAllocator::LinearAllocator(size_t block_size) : _block_size(block_size) {
+}
+
+void* LinearAllocator::allocate(size_t size, size_t alignment) {
+    DEBUG_ASSERT(alignment && (alignment & (alignment - 1)) == 0);
+
+    if(!_blocks.empty()) {
+        const Block& block = _blocks.back();
+        const uintptr_t begin = reinterpret_cast<uintptr_t>(block.data.get());
+        const uintptr_t aligned = (begin + _offset + alignment - 1) & ~uintptr_t(alignment - 1);
+        const size_t end = size_t(aligned - begin) + size;
+        if(end <= block.size) {
+            _offset = end;
+            _allocated += size;
+            return reinterpret_cast<void*>(aligned);
+        }
+    }
+
+    // Full: chain a new block, big enough for this allocation
+    const size_t block_size = std::max(_block_size, size + alignment);
+    _blocks.emplace_back(Block{std::unique_ptr<byte[]>(new byte[block_size]), block_size});
+    _offset = 0;
+    return allocate(size, alignment);
+}
+
+void LinearAllocator::reset() {
+    if(_blocks.size() > 1) {
+        // Replace by a block big enough for everything the last frame needed
+        const size_t total = capacity();
+        _blocks.clear();
+        _blocks.emplace_back(Block{std::unique_ptr<byte[]>(new byte[total]), total});
+    }
+    _offset = 0;
+    _allocated = 0;
+}
+
+size_t LinearAllocator::allocated_bytes() const {
+    return _allocated;
+}
+
+size_t LinearAllocator::capacity() const {
+    size_t total = 0;
+    for(const Block& block : _blocks) {
+        total += block.size;
+    }
+    return total;
+}
+
+void begin_frame_allocations() {
+    frame_index.fetch_add(1, std::memory_order_release);
+}
+
+LinearAllocator& frame_allocator() {
+    thread_local LinearAllocator allocator;
+    thread_local u64 last_frame = 0;
+
+    const u64 frame = frame_index.load(std::memory_order_acquire);
+    if(frame != last_frame) {
+        allocator.reset();
+        last_frame = frame;
+    }
+    return allocator;
+}
+
+}
@@ -0,0 +1,94 @@
+#ifndef FRAMEALLOCATOR_H
+#define FRAMEALLOCATOR_H
+
+#include <utils.h>
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+namespace OM3D {
+
+// Bump allocator: memory is only released all at once by reset().
+// Blocks are kept across resets, and merged into a single one when a frame needed several,
+// so a steady state frame does not touch the heap.
+class LinearAllocator : NonCopyable {
+    public:
+        LinearAllocator(size_t block_size = 1024 * 1024);
+
+        void* allocate(size_t size, size_t alignment);
+        void reset();
+
+        size_t allocated_bytes() const;
+        size_t capacity() const;
+
+    private:
+        struct Block {
+            std::unique_ptr<byte[]> data;
+            size_t size = 0;
+        };
+
+        std::vector<Block> _blocks;
+        size_t _offset = 0;
+        size_t _allocated = 0;
+        size_t _block_size = 0;
+};
+
+// Invalidates everything allocated from the frame allocators, on every thread
+void begin_frame_allocations();
+
+// Allocator of the calling thread, reset on its first use after begin_frame_allocations.
+// Memory must not be kept past the end of the frame.
+LinearAllocator& frame_allocator();
+
+
+// STL allocator adapter, deallocate does nothing
+template<typename T>
+class LinearStlAllocator {
+    public:
+        using value_type = T;
+
+        LinearStlAllocator() : _allocator(&frame_allocator()) {
+        }
+
+        LinearStlAllocator(LinearAllocator& allocator) : _allocator(&allocator) {
+        }
+
+        template<typename U>
+        LinearStlAllocator(const LinearStlAllocator<U>& other) : _allocator(other._allocator) {
+        }
+
+        T* allocate(size_t count) {
+            return static_cast<T*>(_allocator->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t) {
+        }
+
+        template<typename U>
+        bool operator==(const LinearStlAllocator<U>& other) const {
+            return _allocator == other._allocator;
+        }
+
+        template<typename U>
+        bool operator!=(const LinearStlAllocator<U>& other) const {
+            return _allocator != other._allocator;
+        }
+
+    private:
+        template<typename U>
+        friend class LinearStlAllocator;
+
+        LinearAllocator* _allocator = nullptr;
+};
+
+// Transient containers, allocated from the frame allocator of the thread that creates them
+template<typename T>
+using FrameVector = std::vector<T, LinearStlAllocator<T>>;
+
+template<typename K, typename V, typename H = std::hash<K>, typename E = std::equal_to<K>>
+using FrameHashMap = std::unordered_map<K, V, H, E, LinearStlAllocator<std::pair<const K, V>>>;
+
+}
+
+#endif // FRAMEALLOCATOR_H
@@ -0,0 +1,288 @@
+#include "FrameGraph.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+
+namespace OM3D {
+
+// Pooled textures and framebuffers unused for this many frames are destroyed
+static constexpr u64 max_unused_frames = 60;
+
+static u32 barrier_bit(FrameGraph::Access access) {
+    switch(access) {
+        case FrameGraph::Access::Sampled:
+            return GL_TEXTURE_FETCH_BARRIER_BIT;
+
+        case FrameGraph::Access::Image:
+            return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+
+        case FrameGraph::Access::RenderTarget:
+            return GL_FRAMEBUFFER_BARRIER_BIT;
+    }
+
+    FATAL("Unknown access type");
+}
+
+const std::shared_ptr<Texture>& FrameGraph::PassContext::texture(TextureId id) const {
+    DEBUG_ASSERT(id < _graph->_resources.size());
+    return _graph->_resources[id].texture;
+}
+
+void FrameGraph::PassContext::bind_framebuffer(const glm::uvec2& viewport, bool clear_color, bool clear_depth) const {
+    if(const Framebuffer* framebuffer = _graph->framebuffer(_graph->_passes[_pass])) {
+        framebuffer->bind(clear_color, clear_depth);
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if(clear_color || clear_depth) {
+            glClear((clear_color ? GL_COLOR_BUFFER_BIT : 0) | (clear_depth ? GL_DEPTH_BUFFER_BIT : 0));
+        }
+    }
+
+    glViewport(0, 0, viewport.x, viewport.y);
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::read(TextureId id, Access access) {
+    DEBUG_ASSERT(id < _graph->_resources.size());
+    _graph->_passes[_pass].reads.push_back({id, access});
+    return *this;
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::write(TextureId id, Access access) {
+    DEBUG_ASSERT(id < _graph->_resources.size());
+    Pass& pass = _graph->_passes[_pass];
+    pass.writes.push_back({id, access});
+    pass.has_side_effects |= _graph->_resources[id].imported;
+    return *this;
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::write_depth(TextureId id) {
+    write(id, Access::RenderTarget);
+    _graph->_passes[_pass].depth = id;
+    return *this;
+}
+
+FrameGraph::PassBuilder& FrameGraph::PassBuilder::read_depth(TextureId id) {
+    read(id, Access::RenderTarget);
+    _graph->_passes[_pass].depth = id;
+    return *this;
+}
+
+FrameGraph::FrameGraph() {
+    begin_frame();
+}
+
+void FrameGraph::begin_frame() {
+    _passes.clear();
+    _resources.clear();
+
+    Resource& backbuffer_resource = _resources.emplace_back();
+    backbuffer_resource.name = "backbuffer";
+    backbuffer_resource.imported = true;
+
+    ++_frame;
+}
+
+FrameGraph::TextureId FrameGraph::import_texture(const char* name, std::shared_ptr<Texture> texture) {
+    Resource& resource = _resources.emplace_back();
+    resource.name = name;
+    resource.desc.size = texture->size();
+    resource.texture = std::move(texture);
+    resource.imported = true;
+    return TextureId(_resources.size() - 1);
+}
+
+FrameGraph::TextureId FrameGraph::create_texture(const char* name, const TextureDesc& desc) {
+    Resource& resource = _resources.emplace_back();
+    resource.name = name;
+    resource.desc = desc;
+    return TextureId(_resources.size() - 1);
+}
+
+FrameGraph::PassBuilder FrameGraph::add_pass(const char* name, const void* execute_data, ExecuteFunc execute) {
+    Pass& pass = _passes.emplace_back();
+    pass.name = name;
+    pass.execute_data = execute_data;
+    pass.execute = execute;
+    return PassBuilder(this, u32(_passes.size() - 1));
+}
+
+// Walk the passes backward, keeping the ones that write something that is used later
+void FrameGraph::cull_passes() {
+    FrameVector<bool> needed(_resources.size(), false);
+
+    for(auto it = _passes.rbegin(); it != _passes.rend(); ++it) {
+        Pass& pass = *it;
+
+        pass.culled = !pass.has_side_effects && std::none_of(pass.writes.begin(), pass.writes.end(), [&](const TextureAccess& write) {
+            return needed[write.id];
+        });
+
+        if(pass.culled) {
+            continue;
+        }
+
+        // Written resources stay needed: earlier passes may write to them first (clears, blending)
+        for(const TextureAccess& write : pass.writes) {
+            needed[write.id] = true;
+        }
+        for(const TextureAccess& read : pass.reads) {
+            needed[read.id] = true;
+        }
+    }
+}
+
+void FrameGraph::compute_lifetimes() {
+    for(u32 i = 0; i != _passes.size(); ++i) {
+        const Pass& pass = _passes[i];
+        if(pass.culled) {
+            continue;
+        }
+
+        for(const auto* accesses : {&pass.reads, &pass.writes}) {
+            for(const TextureAccess& access : *accesses) {
+                Resource& resource = _resources[access.id];
+                resource.first_use = std::min(resource.first_use, i);
+                resource.last_use = std::max(resource.last_use, i);
+            }
+        }
+    }
+}
+
+void FrameGraph::insert_barriers(const Pass& pass) {
+    u32 barriers = 0;
+    for(const auto* accesses : {&pass.reads, &pass.writes}) {
+        for(const TextureAccess& access : *accesses) {
+            Resource& resource = _resources[access.id];
+            const u32 bit = barrier_bit(access.access);
+            if(resource.pending_barriers & bit) {
+                barriers |= bit;
+                resource.pending_barriers &= ~bit;
+            }
+        }
+    }
+
+    if(barriers) {
+        glMemoryBarrier(barriers);
+    }
+}
+
+std::shared_ptr<Texture> FrameGraph::acquire_texture(const TextureDesc& desc) {
+    for(PooledTexture& pooled : _pool) {
+        if(!pooled.in_use && pooled.desc == desc) {
+            pooled.in_use = true;
+            pooled.last_used_frame = _frame;
+            return pooled.texture;
+        }
+    }
+
+    PooledTexture& pooled = _pool.emplace_back();
+    pooled.desc = desc;
+    pooled.texture = std::make_shared<Texture>(desc.size, desc.format);
+    pooled.in_use = true;
+    pooled.last_used_frame = _frame;
+    return pooled.texture;
+}
+
+void FrameGraph::release_texture(const std::shared_ptr<Texture>& texture) {
+    for(PooledTexture& pooled : _pool) {
+        if(pooled.texture == texture) {
+            pooled.in_use = false;
+            return;
+        }
+    }
+}
+
+const Framebuffer* FrameGraph::framebuffer(const Pass& pass) const {
+    FrameVector<const Texture*> attachments;
+    attachments.push_back(_resources[pass.depth].texture.get());
+
+    FrameVector<Texture*> colors;
+    for(const TextureAccess& write : pass.writes) {
+        if(write.access != Access::RenderTarget || write.id == pass.depth) {
+            continue;
+        }
+
+        if(write.id == backbuffer) {
+            return nullptr;
+        }
+
+        colors.push_back(_resources[write.id].texture.get());
+        attachments.push_back(colors.back());
+    }
+
+    for(CachedFramebuffer& cached : _framebuffers) {
+        if(std::equal(cached.attachments.begin(), cached.attachments.end(), attachments.begin(), attachments.end())) {
+            cached.last_used_frame = _frame;
+            return &cached.framebuffer;
+        }
+    }
+
+    Texture* depth = _resources[pass.depth].texture.get();
+    CachedFramebuffer& cached = _framebuffers.emplace_back(CachedFramebuffer{
+        std::vector<const Texture*>(attachments.begin(), attachments.end()),
+        Framebuffer(depth, Span<Texture*>(colors.data(), colors.size())),
+        _frame
+    });
+    return &cached.framebuffer;
+}
+
+void FrameGraph::collect_garbage() {
+    // Framebuffers go first: they can't outlive their attachments
+    _framebuffers.erase(std::remove_if(_framebuffers.begin(), _framebuffers.end(), [&](const CachedFramebuffer& cached) {
+        return cached.last_used_frame + max_unused_frames < _frame;
+    }), _framebuffers.end());
+
+    _pool.erase(std::remove_if(_pool.begin(), _pool.end(), [&](const PooledTexture& pooled) {
+        return !pooled.in_use && pooled.last_used_frame + max_unused_frames < _frame;
+    }), _pool.end());
+}
+
+void FrameGraph::execute() {
+    cull_passes();
+    compute_lifetimes();
+
+    _stats = {};
+    _stats.pass_count = u32(_passes.size());
+
+    for(u32 i = 0; i != _passes.size(); ++i) {
+        const Pass& pass = _passes[i];
+        if(pass.culled) {
+            continue;
+        }
+
+        for(Resource& resource : _resources) {
+            if(!resource.imported && resource.first_use == i) {
+                resource.texture = acquire_texture(resource.desc);
+                ++_stats.transient_count;
+            }
+        }
+
+        insert_barriers(pass);
+
+        pass.execute(pass.execute_data, PassContext(this, i));
+        ++_stats.executed_pass_count;
+
+        for(const TextureAccess& write : pass.writes) {
+            if(write.access == Access::Image) {
+                _resources[write.id].pending_barriers = barrier_bit(Access::Sampled) | barrier_bit(Access::Image) | barrier_bit(Access::RenderTarget);
+            }
+        }
+
+        // Storage can be reused by the next passes
+        for(const Resource& resource : _resources) {
+            if(!resource.imported && resource.last_use == i && resource.texture) {
+                release_texture(resource.texture);
+            }
+        }
+    }
+
+    collect_garbage();
+    _stats.physical_texture_count = u32(_pool.size());
+}
+
+const FrameGraph::Stats& FrameGraph::stats() const {
+    return _stats;
+}
+
+}
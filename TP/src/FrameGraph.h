@@ -0,0 +1,182 @@
+#ifndef FRAMEGRAPH_H
+#define FRAMEGRAPH_H
+
+#include <Framebuffer.h>
+#include <FrameAllocator.h>
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace OM3D {
+
+// Passes declare the textures they read and write, the graph then:
+// - culls passes whose results are never used (writing an imported texture keeps a pass alive),
+// - inserts the memory barriers needed between passes,
+// - allocates transient textures from a pool, textures with the same description and non overlapping lifetimes share storage.
+// The graph is rebuilt every frame from the frame allocator, the pool and framebuffers persist.
+class FrameGraph : NonMovable {
+    public:
+        using TextureId = u32;
+
+        // The default framebuffer
+        static constexpr TextureId backbuffer = 0;
+
+        enum class Access {
+            Sampled,
+            Image,
+            RenderTarget,
+        };
+
+        struct TextureDesc {
+            glm::uvec2 size = {};
+            ImageFormat format = ImageFormat::RGBA8_UNORM;
+
+            bool operator==(const TextureDesc& other) const {
+                return size == other.size && format == other.format;
+            }
+        };
+
+        class PassContext {
+            public:
+                const std::shared_ptr<Texture>& texture(TextureId id) const;
+
+                // Bind the render targets of the pass, and set the viewport
+                void bind_framebuffer(const glm::uvec2& viewport, bool clear_color = true, bool clear_depth = true) const;
+
+            private:
+                friend class FrameGraph;
+
+                PassContext(const FrameGraph* graph, u32 pass) : _graph(graph), _pass(pass) {
+                }
+
+                const FrameGraph* _graph = nullptr;
+                u32 _pass = 0;
+        };
+
+        class PassBuilder {
+            public:
+                PassBuilder& read(TextureId id, Access access = Access::Sampled);
+                PassBuilder& write(TextureId id, Access access = Access::RenderTarget);
+
+                // Depth attachment, the others render targets are bound in write order
+                PassBuilder& write_depth(TextureId id);
+                // Depth attachment only used for depth tests
+                PassBuilder& read_depth(TextureId id);
+
+            private:
+                friend class FrameGraph;
+
+                PassBuilder(FrameGraph* graph, u32 pass) : _graph(graph), _pass(pass) {
+                }
+
+                FrameGraph* _graph = nullptr;
+                u32 _pass = 0;
+        };
+
+        struct Stats {
+            u32 pass_count = 0;
+            u32 executed_pass_count = 0;
+            u32 transient_count = 0;
+            u32 physical_texture_count = 0;
+        };
+
+        FrameGraph();
+
+        // Clears the passes and resources of the previous frame
+        void begin_frame();
+
+        // Names are not copied, they must live until execute() (string literals)
+        TextureId import_texture(const char* name, std::shared_ptr<Texture> texture);
+        TextureId create_texture(const char* name, const TextureDesc& desc);
+
+        // execute is copied to the frame allocator and never destroyed, so it has to be trivially destructible
+        // (lambdas capturing by reference are)
+        template<typename F>
+        PassBuilder add_pass(const char* name, F&& execute) {
+            using Func = std::decay_t<F>;
+            static_assert(std::is_trivially_destructible_v<Func>, "Pass functions are never destroyed");
+
+            void* storage = frame_allocator().allocate(sizeof(Func), alignof(Func));
+            const Func* func = new(storage) Func(std::forward<F>(execute));
+            return add_pass(name, func, [](const void* f, const PassContext& context) {
+                (*static_cast<const Func*>(f))(context);
+            });
+        }
+
+        void execute();
+
+        const Stats& stats() const;
+
+    private:
+        struct TextureAccess {
+            TextureId id;
+            Access access;
+        };
+
+        using ExecuteFunc = void (*)(const void*, const PassContext&);
+
+        struct Pass {
+            const char* name = nullptr;
+            const void* execute_data = nullptr;
+            ExecuteFunc execute = nullptr;
+
+            FrameVector<TextureAccess> reads;
+            FrameVector<TextureAccess> writes;
+            TextureId depth = backbuffer;
+
+            bool has_side_effects = false;
+            bool culled = false;
+        };
+
+        struct Resource {
+            const char* name = nullptr;
+            TextureDesc desc;
+            std::shared_ptr<Texture> texture;
+            bool imported = false;
+
+            // Barriers needed before the next accesses, set by image writes
+            u32 pending_barriers = 0;
+
+            // Lifetime, in pass indices
+            u32 first_use = u32(-1);
+            u32 last_use = 0;
+        };
+
+        struct PooledTexture {
+            TextureDesc desc;
+            std::shared_ptr<Texture> texture;
+            bool in_use = false;
+            u64 last_used_frame = 0;
+        };
+
+        struct CachedFramebuffer {
+            std::vector<const Texture*> attachments;
+            Framebuffer framebuffer;
+            u64 last_used_frame = 0;
+        };
+
+        PassBuilder add_pass(const char* name, const void* execute_data, ExecuteFunc execute);
+
+        void cull_passes();
+        void compute_lifetimes();
+        void insert_barriers(const Pass& pass);
+        std::shared_ptr<Texture> acquire_texture(const TextureDesc& desc);
+        void release_texture(const std::shared_ptr<Texture>& texture);
+        const Framebuffer* framebuffer(const Pass& pass) const;
+        void collect_garbage();
+
+        std::vector<Pass> _passes;
+        std::vector<Resource> _resources;
+
+        std::vector<PooledTexture> _pool;
+        mutable std::vector<CachedFramebuffer> _framebuffers;
+
+        u64 _frame = 0;
+        Stats _stats;
+};
+
+}
+
+#endif // FRAMEGRAPH_H
@@ -18,9 +18,13 @@ Framebuffer::Framebuffer() {
 Framebuffer::Framebuffer(Texture* depth) : Framebuffer(depth, nullptr, 0) {
 }
 
+Framebuffer::Framebuffer(Texture* depth, Span<Texture*> colors) : Framebuffer(depth, colors.data(), colors.size()) {
+}
+
 Framebuffer::Framebuffer(Texture* depth, Texture** colors, size_t count) : _handle(create_framebuffer_handle()) {
     if(depth) {
-        glNamedFramebufferTexture(_handle.get(), GL_DEPTH_ATTACHMENT, depth->_handle.get(), 0);
+        const GLenum attachment = has_stencil(depth->_format) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+        glNamedFramebufferTexture(_handle.get(), attachment, depth->_handle.get(), 0);
         _size = depth->size();
     }
 
@@ -68,11 +72,16 @@ void Framebuffer::bind(bool clear_color, bool clear_depth) const {
     glViewport(0, 0, _size.x, _size.y);
 
     if(clear_color || clear_depth) {
+        // Clears are affected by the write masks left by the last material
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthMask(GL_TRUE);
+        glStencilMask(0xFF);
+
         GLbitfield mask = 0;
         if (clear_color)
             mask |= GL_COLOR_BUFFER_BIT;
         if (clear_depth)
-            mask |= GL_DEPTH_BUFFER_BIT;
+            mask |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
         glClear(mask);
     }
 }
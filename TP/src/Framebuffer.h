@@ -7,6 +7,16 @@
 
 namespace OM3D {
 
+// Part of the render targets actually rendered to, smaller than the targets when using dynamic resolution
+struct Viewport {
+    glm::uvec2 size = {};
+    glm::uvec2 target_size = {};
+
+    glm::vec2 uv_scale() const {
+        return glm::vec2(size) / glm::vec2(target_size);
+    }
+};
+
 class Framebuffer : NonCopyable {
     public:
         template<size_t N>
@@ -16,6 +26,7 @@ class Framebuffer : NonCopyable {
 
         Framebuffer();
         Framebuffer(Texture* depth);
+        Framebuffer(Texture* depth, Span<Texture*> colors);
 
         Framebuffer(Framebuffer&&) = default;
         Framebuffer& operator=(Framebuffer&&) = default;
@@ -0,0 +1,25 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <ImageFormat.h>
+
+namespace OM3D {
+
+// Formats of the deferred pipeline render targets
+struct GBufferLayout {
+    ImageFormat albedo = ImageFormat::RGBA8_sRGB;
+
+    // Octahedral encoded normals remapped to [0, 1] (see encode_normal in utils.glsl).
+    // SNORM formats are not guaranteed to be color renderable, so this has to be a 2 channels UNORM format.
+    ImageFormat normal = ImageFormat::RG16_UNORM;
+
+    // Stencil is used to mark the pixels lit by point lights
+    ImageFormat depth = ImageFormat::Depth32_FLOAT_Stencil8;
+
+    // HDR lighting result, alpha is never used
+    ImageFormat lit = ImageFormat::R11G11B10_FLOAT;
+};
+
+}
+
+#endif // GBUFFER_H
@@ -0,0 +1,263 @@
+#include "HiZBuffer.h"
+
+#include <Camera.h>
+
+#include <glad/glad.h>
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <array>
+
+namespace OM3D {
+
+// The CPU tests use the first level that fits in this size
+static constexpr u32 max_read_back_size = 256;
+
+static glm::uvec2 pyramid_size(const Texture* depth) {
+    return glm::max(glm::uvec2(1), depth->size() / 2u);
+}
+
+static u32 group_count(u32 size) {
+    return align_up_to(size, 8) / 8;
+}
+
+HiZBuffer::HiZBuffer(const Texture* depth) :
+        _depth(depth),
+        _pyramid(pyramid_size(depth), ImageFormat::R32_FLOAT, Texture::mip_levels(pyramid_size(depth))),
+        _mip_count(Texture::mip_levels(pyramid_size(depth))),
+        _from_depth_program(Program::from_file("hiz.comp", {"FROM_DEPTH"})),
+        _downsample_program(Program::from_file("hiz.comp")) {
+
+    while(_read_back_mip + 1 < _mip_count) {
+        const glm::uvec2 size = _pyramid.mip_size(_read_back_mip);
+        if(std::max(size.x, size.y) <= max_read_back_size) {
+            break;
+        }
+        ++_read_back_mip;
+    }
+
+    const glm::uvec2 size = _pyramid.mip_size(_read_back_mip);
+    _read_back_buffer = TypedBuffer<float>(nullptr, size.x * size.y);
+}
+
+HiZBuffer::~HiZBuffer() {
+    if(_fence) {
+        glDeleteSync(static_cast<GLsync>(_fence));
+    }
+}
+
+void HiZBuffer::build() {
+    _depth->bind(0);
+    _pyramid.bind_as_image(1, AccessType::WriteOnly, 0);
+    _from_depth_program->bind();
+    {
+        const glm::uvec2 size = _pyramid.mip_size(0);
+        glDispatchCompute(group_count(size.x), group_count(size.y), 1);
+    }
+
+    _downsample_program->bind();
+    for(u32 mip = 1; mip <= _read_back_mip; ++mip) {
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        _pyramid.bind_as_image(0, AccessType::ReadOnly, mip - 1);
+        _pyramid.bind_as_image(1, AccessType::WriteOnly, mip);
+
+        const glm::uvec2 size = _pyramid.mip_size(mip);
+        glDispatchCompute(group_count(size.x), group_count(size.y), 1);
+    }
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void HiZBuffer::fetch() {
+    if(!_fence) {
+        return;
+    }
+
+    const GLsync fence = static_cast<GLsync>(_fence);
+    const GLenum status = glClientWaitSync(fence, 0, 0);
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        return;
+    }
+
+    glDeleteSync(fence);
+    _fence = nullptr;
+
+    Span<float> depth = _levels.reset(_depth->size(), _read_back_mip + 1);
+    {
+        auto mapping = _read_back_buffer.map(AccessType::ReadOnly);
+        std::copy_n(mapping.data(), depth.size(), depth.data());
+    }
+
+    _view_proj = _pending_view_proj;
+    _uv_scale = _pending_uv_scale;
+    _levels.build();
+}
+
+void HiZBuffer::update(const glm::mat4& view_proj, const glm::vec2& uv_scale, bool sync) {
+    if(sync) {
+        if(_fence) {
+            glDeleteSync(static_cast<GLsync>(_fence));
+            _fence = nullptr;
+        }
+
+        build();
+
+        Span<float> depth = _levels.reset(_depth->size(), _read_back_mip + 1);
+        _pyramid.read_back(_read_back_mip, depth.data(), depth.size() * sizeof(float));
+
+        _view_proj = view_proj;
+        _uv_scale = uv_scale;
+        _levels.build();
+        return;
+    }
+
+    if(_fence) {
+        // Previous read back is still in flight
+        return;
+    }
+
+    build();
+
+    _read_back_buffer.bind(BufferUsage::PixelPack);
+    _pyramid.read_back(_read_back_mip, nullptr, _read_back_buffer.byte_size());
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _pending_view_proj = view_proj;
+    _pending_uv_scale = uv_scale;
+}
+
+static glm::uvec2 reduced_size(const glm::uvec2& size) {
+    return glm::max(glm::uvec2(1), size / 2u);
+}
+
+Span<float> HiZLevels::reset(const glm::uvec2& source_size, u32 reduction_count) {
+    glm::uvec2 size = source_size;
+    for(u32 i = 0; i != reduction_count; ++i) {
+        size = reduced_size(size);
+    }
+
+    _source_size = source_size;
+    _reduction_count = reduction_count;
+    _levels.resize(1);
+    _levels[0].size = size;
+    _levels[0].depth.resize(size.x * size.y);
+    return _levels[0].depth;
+}
+
+// Finish the pyramid on the CPU from the read back level, so big objects can be tested with a few texels
+void HiZLevels::build() {
+    _levels.resize(1);
+    while(_levels.back().size.x > 1 || _levels.back().size.y > 1) {
+        const Level& prev = _levels.back();
+
+        Level level;
+        level.size = reduced_size(prev.size);
+        level.depth.resize(level.size.x * level.size.y);
+
+        for(u32 y = 0; y != level.size.y; ++y) {
+            for(u32 x = 0; x != level.size.x; ++x) {
+                // Same as hiz.comp
+                const u32 last_x = std::min(x * 2 + 1 + (x + 1 == level.size.x ? prev.size.x & 1 : 0), prev.size.x - 1);
+                const u32 last_y = std::min(y * 2 + 1 + (y + 1 == level.size.y ? prev.size.y & 1 : 0), prev.size.y - 1);
+
+                float depth = 1.0f;
+                for(u32 py = y * 2; py <= last_y; ++py) {
+                    for(u32 px = x * 2; px <= last_x; ++px) {
+                        depth = std::min(depth, prev.depth[py * prev.size.x + px]);
+                    }
+                }
+                level.depth[y * level.size.x + x] = depth;
+            }
+        }
+
+        _levels.emplace_back(std::move(level));
+    }
+}
+
+bool HiZLevels::is_empty() const {
+    return _levels.empty();
+}
+
+bool HiZLevels::is_occluded(const glm::vec2& min_uv, const glm::vec2& max_uv, float nearest_depth) const {
+    if(_levels.empty()) {
+        return false;
+    }
+
+    // Scaling the UVs by the level size is off on levels reduced from an odd size, where the last texel also covers
+    // the left over row/column: follow the texels covering the bounds through the same reductions instead.
+    glm::uvec2 size = _source_size;
+    glm::uvec2 first = glm::min(glm::uvec2(min_uv * glm::vec2(size)), size - 1u);
+    glm::uvec2 last = glm::min(glm::uvec2(max_uv * glm::vec2(size)), size - 1u);
+    const auto reduce = [&] {
+        size = reduced_size(size);
+        first = glm::min(first / 2u, size - 1u);
+        last = glm::min(last / 2u, size - 1u);
+    };
+
+    for(u32 i = 0; i != _reduction_count; ++i) {
+        reduce();
+    }
+
+    // Pick the finest level where the bounds cover at most 4x4 texels
+    for(size_t l = 0; l != _levels.size(); ++l) {
+        if(l) {
+            reduce();
+        }
+
+        const Level& level = _levels[l];
+        DEBUG_ASSERT(size == level.size);
+        if(last.x - first.x >= 4 || last.y - first.y >= 4) {
+            continue;
+        }
+
+        for(u32 y = first.y; y <= last.y; ++y) {
+            for(u32 x = first.x; x <= last.x; ++x) {
+                if(level.depth[y * level.size.x + x] <= nearest_depth) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool HiZBuffer::is_occluded(const BoundingSphere& sphere) const {
+    if(_levels.is_empty()) {
+        return false;
+    }
+
+    const glm::vec3 extent(sphere.radius);
+    const auto bounds = project_box(_view_proj, sphere.center - extent, sphere.center + extent);
+    if(!bounds.is_ok) {
+        // Crosses the camera plane
+        return false;
+    }
+
+    // Texels outside of the viewport are cleared to the far plane, so sampling them is conservative
+    const glm::vec2 min_uv = bounds.value.min_uv * _uv_scale;
+    const glm::vec2 max_uv = bounds.value.max_uv * _uv_scale;
+    if(min_uv.x >= max_uv.x || min_uv.y >= max_uv.y) {
+        return false;
+    }
+
+    return _levels.is_occluded(min_uv, max_uv, bounds.value.nearest_depth);
+}
+
+bool HiZBuffer::is_two_phase() const {
+    return _two_phase;
+}
+
+void HiZBuffer::set_two_phase(bool two_phase) {
+    _two_phase = two_phase;
+}
+
+const Texture& HiZBuffer::texture() const {
+    return _pyramid;
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef HIZBUFFER_H
+#define HIZBUFFER_H
+
+#include <Texture.h>
+#include <Program.h>
+#include <TypedBuffer.h>
+#include <StaticMesh.h>
+
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// CPU levels of the pyramid, does not touch GL.
+// Every level halves the previous one, with the odd last row/column folded into the last texel (same as hiz.comp).
+class HiZLevels {
+    struct Level {
+        glm::uvec2 size;
+        std::vector<float> depth;
+    };
+
+    public:
+        // Starts over from a first level reduced reduction_count times from a depth buffer of source_size.
+        // Returns the first level depth, to fill before calling build.
+        Span<float> reset(const glm::uvec2& source_size, u32 reduction_count);
+
+        // Reduces the first level down to a single texel
+        void build();
+
+        bool is_empty() const;
+
+        // Returns true if the bounds (UVs in the depth buffer) are behind every texel they cover
+        bool is_occluded(const glm::vec2& min_uv, const glm::vec2& max_uv, float nearest_depth) const;
+
+    private:
+        glm::uvec2 _source_size = {};
+        u32 _reduction_count = 0;
+        std::vector<Level> _levels;
+};
+
+// Min depth pyramid (we use reverse-Z) built from a depth buffer, read back on the CPU to cull objects
+class HiZBuffer : NonMovable {
+    public:
+        HiZBuffer(const Texture* depth);
+        ~HiZBuffer();
+
+        // Retrieve the last read back if it has completed, never blocks
+        void fetch();
+
+        // Build the pyramid from the depth buffer, as rendered with view_proj, and start reading it back.
+        // uv_scale is the part of the depth buffer covered by the viewport.
+        // If sync is set, the result is available immediately (used by the two-phase mode).
+        void update(const glm::mat4& view_proj, const glm::vec2& uv_scale, bool sync = false);
+
+        // Returns true if the sphere is behind the depth of the last fetched pyramid
+        bool is_occluded(const BoundingSphere& sphere) const;
+
+        bool is_two_phase() const;
+        void set_two_phase(bool two_phase);
+
+        const Texture& texture() const;
+
+    private:
+        void build();
+
+        const Texture* _depth = nullptr;
+        Texture _pyramid;
+        u32 _mip_count = 0;
+        u32 _read_back_mip = 0;
+
+        std::shared_ptr<Program> _from_depth_program;
+        std::shared_ptr<Program> _downsample_program;
+
+        TypedBuffer<float> _read_back_buffer;
+        void* _fence = nullptr;
+        glm::mat4 _pending_view_proj;
+        glm::vec2 _pending_uv_scale = glm::vec2(1.0f);
+
+        HiZLevels _levels;
+        glm::mat4 _view_proj;
+        glm::vec2 _uv_scale = glm::vec2(1.0f);
+
+        bool _two_phase = false;
+};
+
+}
+
+#endif // HIZBUFFER_H
@@ -1,6 +1,7 @@
 #include "ImGuiRenderer.h"
 
 #include <TypedBuffer.h>
+#include <CommandBuffer.h>
 
 #include <glm/vec2.hpp>
 
@@ -152,7 +153,7 @@ static std::unique_ptr<Texture> create_font() {
     TextureData data;
     data.format = ImageFormat::RGBA8_UNORM;
     data.size = glm::uvec2(width, height);
-    data.data = std::make_unique<u8[]>(bytes);
+    data.data = TextureData::allocate(bytes);
     std::copy_n(font_data, bytes, data.data.get());
 
     return std::make_unique<Texture>(data);
@@ -239,7 +240,6 @@ void ImGuiRenderer::render(const ImDrawData* draw_data) {
     const ImVec2 clip_scale = draw_data->FramebufferScale;
 
     _material.set_uniform(HASH("viewport_size"), glm::vec2(draw_data->DisplaySize.x, draw_data->DisplaySize.y));
-    _material.bind();
 
     glEnable(GL_SCISSOR_TEST);
     DEFER(glDisable(GL_SCISSOR_TEST));
@@ -265,12 +265,23 @@ void ImGuiRenderer::render(const ImDrawData* draw_data) {
     index_buffer.bind(BufferUsage::Index);
     vertex_buffer.bind(BufferUsage::Attribute);
 
-    byte* vertex_offset = nullptr;
-    byte* index_offset = nullptr;
+    // Draw lists are offset with the base vertex, the attributes only need to be set once
+    glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(ImDrawVert), nullptr);
+    glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(ImDrawVert), reinterpret_cast<void*>(2 * sizeof(float)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, false, sizeof(ImDrawVert), reinterpret_cast<void*>(4 * sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+
+    // ImGui draws in submission order: every command has the same key
+    CommandBuffer commands;
+
+    u32 vertex_offset = 0;
+    u32 index_offset = 0;
     for(int c = 0; c != draw_data->CmdListsCount; ++c) {
         const ImDrawList* cmd_list = draw_data->CmdLists[c];
 
-        byte* drawn_index_offset = index_offset;
+        u32 drawn_index_offset = index_offset;
         for(int i = 0; i != cmd_list->CmdBuffer.Size; ++i) {
             const ImDrawCmd& cmd = cmd_list->CmdBuffer[i];
 
@@ -282,26 +293,21 @@ void ImGuiRenderer::render(const ImDrawData* draw_data) {
                 continue;
             }
 
-            glScissor(int(clip_min.x), int(height - clip_max.y), int(clip_max.x - clip_min.x), int(clip_max.y - clip_min.y));
+            commands.set_scissor(0, int(clip_min.x), int(height - clip_max.y), int(clip_max.x - clip_min.x), int(clip_max.y - clip_min.y));
 
-            if(Texture* tex = static_cast<Texture*>(cmd.TextureId)) {
-                tex->bind(0);
+            if(const Texture* tex = static_cast<const Texture*>(cmd.TextureId)) {
+                commands.bind_texture(0, tex, 0);
             }
 
-            glVertexAttribPointer(0, 2, GL_FLOAT, false, sizeof(ImDrawVert), vertex_offset);
-            glVertexAttribPointer(1, 2, GL_FLOAT, false, sizeof(ImDrawVert), vertex_offset + (2 * sizeof(float)));
-            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, false, sizeof(ImDrawVert), vertex_offset + (4 * sizeof(float)));
-            glEnableVertexAttribArray(0);
-            glEnableVertexAttribArray(1);
-            glEnableVertexAttribArray(2);
-
-            glDrawElements(GL_TRIANGLES, cmd.ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, reinterpret_cast<void*>(drawn_index_offset));
-            drawn_index_offset += cmd.ElemCount * sizeof(ImDrawIdx);
+            commands.draw_indexed(0, &_material, cmd.ElemCount, drawn_index_offset, i32(vertex_offset), sizeof(ImDrawIdx));
+            drawn_index_offset += cmd.ElemCount;
         }
 
-        vertex_offset += cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
-        index_offset += cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+        vertex_offset += cmd_list->VtxBuffer.Size;
+        index_offset += cmd_list->IdxBuffer.Size;
     }
+
+    commands.submit();
 }
 
 }
@@ -10,8 +10,35 @@ ImageFormatGL image_format_to_gl(ImageFormat format) {
         case ImageFormat::RGBA8_sRGB:       return ImageFormatGL{ GL_RGBA, GL_SRGB8_ALPHA8, GL_UNSIGNED_BYTE };
         case ImageFormat::RGB8_UNORM:       return ImageFormatGL{ GL_RGB, GL_RGB8, GL_UNSIGNED_BYTE };
         case ImageFormat::RGB8_sRGB:        return ImageFormatGL{ GL_RGB, GL_SRGB8, GL_UNSIGNED_BYTE };
+        case ImageFormat::RG16_UNORM:       return ImageFormatGL{ GL_RG, GL_RG16, GL_UNSIGNED_SHORT };
+        case ImageFormat::RG16_SNORM:       return ImageFormatGL{ GL_RG, GL_RG16_SNORM, GL_SHORT };
         case ImageFormat::RGBA16_FLOAT:     return ImageFormatGL{ GL_RGBA, GL_RGBA16F, GL_FLOAT };
+        case ImageFormat::R11G11B10_FLOAT:  return ImageFormatGL{ GL_RGB, GL_R11F_G11F_B10F, GL_FLOAT };
+        case ImageFormat::R32_FLOAT:        return ImageFormatGL{ GL_RED, GL_R32F, GL_FLOAT };
         case ImageFormat::Depth32_FLOAT:    return ImageFormatGL{ GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT32F, GL_FLOAT };
+        case ImageFormat::Depth32_FLOAT_Stencil8: return ImageFormatGL{ GL_DEPTH_STENCIL, GL_DEPTH32F_STENCIL8, GL_FLOAT_32_UNSIGNED_INT_24_8_REV };
+    }
+
+    FATAL("Unknown image format");
+}
+
+bool has_stencil(ImageFormat format) {
+    return format == ImageFormat::Depth32_FLOAT_Stencil8;
+}
+
+u32 bytes_per_pixel(ImageFormat format) {
+    switch(format) {
+        case ImageFormat::RGBA8_UNORM:      return 4;
+        case ImageFormat::RGBA8_sRGB:       return 4;
+        case ImageFormat::RGB8_UNORM:       return 3;
+        case ImageFormat::RGB8_sRGB:        return 3;
+        case ImageFormat::RG16_UNORM:       return 4;
+        case ImageFormat::RG16_SNORM:       return 4;
+        case ImageFormat::RGBA16_FLOAT:     return 16;
+        case ImageFormat::R11G11B10_FLOAT:  return 12;
+        case ImageFormat::R32_FLOAT:        return 4;
+        case ImageFormat::Depth32_FLOAT:    return 4;
+        case ImageFormat::Depth32_FLOAT_Stencil8: return 8;
     }
 
     FATAL("Unknown image format");
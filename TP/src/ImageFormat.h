@@ -11,8 +11,14 @@ enum class ImageFormat {
     RGB8_UNORM,
     RGB8_sRGB,
 
+    RG16_UNORM,
+    RG16_SNORM,
+
     RGBA16_FLOAT,
-    Depth32_FLOAT
+    R11G11B10_FLOAT,
+    R32_FLOAT,
+    Depth32_FLOAT,
+    Depth32_FLOAT_Stencil8
 };
 
 
@@ -24,6 +30,11 @@ struct ImageFormatGL {
 
 ImageFormatGL image_format_to_gl(ImageFormat format);
 
+bool has_stencil(ImageFormat format);
+
+// Size of a pixel in the client format given by image_format_to_gl
+u32 bytes_per_pixel(ImageFormat format);
+
 }
 
 #endif // IMAGEFORMAT_H
@@ -2,6 +2,8 @@
 
 #include <glad/glad.h>
 
+#include <AllocationTracker.h>
+
 #include <algorithm>
 
 namespace OM3D {
@@ -11,6 +13,8 @@ Material::Material() {
 
 void Material::set_program(std::shared_ptr<Program> prog) {
     _program = std::move(prog);
+    _fallback_program = nullptr;
+    _uniforms_pending = !_uniforms.empty();
 }
 
 void Material::set_blend_mode(BlendMode blend) {
@@ -22,7 +26,7 @@ void Material::set_depth_test_mode(DepthTestMode depth) {
 }
 
 void Material::set_texture(u32 slot, std::shared_ptr<Texture> tex) {
-    if(const auto it = std::find_if(_textures.begin(), _textures.end(), [&](const auto& t) { return t.second == tex; }); it != _textures.end()) {
+    if(const auto it = std::find_if(_textures.begin(), _textures.end(), [&](const auto& t) { return t.first == slot; }); it != _textures.end()) {
         it->second = std::move(tex);
     } else {
         _textures.emplace_back(slot, std::move(tex));
@@ -33,74 +37,186 @@ void Material::set_write_depth(bool write) {
     _write_depth = write;
 }
 
+void Material::set_write_color(bool write) {
+    _write_color = write;
+}
+
 void Material::set_cull_mode(CullMode face) {
     _cull_mode = face;
 }
 
-void Material::bind() const {
-    switch(_blend_mode) {
-        case BlendMode::None:
-            glDisable(GL_BLEND);
-            glEnable(GL_CULL_FACE);
-        break;
-
-        case BlendMode::Alpha:
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            glDisable(GL_CULL_FACE);
-        break;
-
-        case BlendMode::Add:
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_COLOR, GL_ONE);
-            glEnable(GL_CULL_FACE);
-        break;
+void Material::set_stencil_mode(StencilMode stencil) {
+    _stencil_mode = stencil;
+}
+
+void Material::set_uniform_value(u32 name_hash, UniformValue value) {
+    const auto it = std::find_if(_uniforms.begin(), _uniforms.end(), [&](const auto& u) { return u.first == name_hash; });
+    if(it != _uniforms.end()) {
+        it->second = value;
+    } else {
+        _uniforms.emplace_back(name_hash, value);
     }
 
-    switch(_depth_test_mode) {
-        case DepthTestMode::None:
-            glDisable(GL_DEPTH_TEST);
-        break;
-
-        case DepthTestMode::Equal:
-            glEnable(GL_DEPTH_TEST);
-            glDepthFunc(GL_EQUAL);
-        break;
-
-        case DepthTestMode::Standard:
-            glEnable(GL_DEPTH_TEST);
-            // We are using reverse-Z
-            glDepthFunc(GL_GEQUAL);
-        break;
-
-        case DepthTestMode::Reversed:
-            glEnable(GL_DEPTH_TEST);
-            // We are using reverse-Z
-            glDepthFunc(GL_LEQUAL);
-        break;
-
-        case DepthTestMode::Always:
-            glEnable(GL_DEPTH_TEST);
-            glDepthFunc(GL_ALWAYS);
-        break;
+    // Uniform locations are only known once the program is linked
+    if(_program && _program->is_ready()) {
+        std::visit([&](const auto& v) { _program->set_uniform(name_hash, v); }, value);
+    } else {
+        _uniforms_pending = true;
     }
+}
 
-    switch (_cull_mode) {
-        case CullMode::Frontface:
-            glCullFace(GL_FRONT);
-        break;
-        
-        case CullMode::Backface:
-            glCullFace(GL_BACK);
-        break;
+void Material::apply_uniforms() const {
+    for(const auto& uniform : _uniforms) {
+        std::visit([&](const auto& v) { _program->set_uniform(uniform.first, v); }, uniform.second);
     }
-    
-    glDepthMask(_write_depth ? GL_TRUE : GL_FALSE);
+    _uniforms_pending = false;
+}
+
+// Spreads pointers over the high bits, which is what draw keys keep
+static u32 pointer_id(const void* ptr) {
+    return u32((u64(reinterpret_cast<uintptr_t>(ptr)) * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+BlendMode Material::blend_mode() const {
+    return _blend_mode;
+}
 
+u32 Material::program_id() const {
+    return pointer_id(_program.get());
+}
+
+u32 Material::texture_set_id() const {
+    u32 id = 0;
     for(const auto& texture : _textures) {
-        texture.second->bind(texture.first);
+        hash_combine(id, texture.first ^ pointer_id(texture.second.get()));
+    }
+    return id;
+}
+
+bool Material::has_texture(u32 slot) const {
+    return std::any_of(_textures.begin(), _textures.end(), [&](const auto& t) { return t.first == slot; });
+}
+
+const Program* Material::active_program() const {
+    return (_program->is_ready() || !_fallback_program) ? _program.get() : _fallback_program.get();
+}
+
+void Material::bind(const Material* previous) const {
+    ALLOCATION_SCOPE("Material::bind");
+
+    // Blending also decides face culling
+    if(!previous || previous->_blend_mode != _blend_mode || previous->_cull_mode != _cull_mode) {
+        switch(_blend_mode) {
+            case BlendMode::None:
+                glDisable(GL_BLEND);
+                glEnable(GL_CULL_FACE);
+            break;
+
+            case BlendMode::Alpha:
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDisable(GL_CULL_FACE);
+            break;
+
+            case BlendMode::Add:
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_COLOR, GL_ONE);
+                glEnable(GL_CULL_FACE);
+            break;
+        }
+
+        switch (_cull_mode) {
+            case CullMode::Frontface:
+                glCullFace(GL_FRONT);
+            break;
+        
+            case CullMode::Backface:
+                glCullFace(GL_BACK);
+            break;
+
+            case CullMode::None:
+                glDisable(GL_CULL_FACE);
+            break;
+        }
+    }
+
+    if(!previous || previous->_depth_test_mode != _depth_test_mode) {
+        switch(_depth_test_mode) {
+            case DepthTestMode::None:
+                glDisable(GL_DEPTH_TEST);
+            break;
+
+            case DepthTestMode::Equal:
+                glEnable(GL_DEPTH_TEST);
+                glDepthFunc(GL_EQUAL);
+            break;
+
+            case DepthTestMode::Standard:
+                glEnable(GL_DEPTH_TEST);
+                // We are using reverse-Z
+                glDepthFunc(GL_GEQUAL);
+            break;
+
+            case DepthTestMode::Reversed:
+                glEnable(GL_DEPTH_TEST);
+                // We are using reverse-Z
+                glDepthFunc(GL_LEQUAL);
+            break;
+
+            case DepthTestMode::Always:
+                glEnable(GL_DEPTH_TEST);
+                glDepthFunc(GL_ALWAYS);
+            break;
+        }
+    }
+
+    if(!previous || previous->_stencil_mode != _stencil_mode) {
+        switch(_stencil_mode) {
+            case StencilMode::None:
+                glDisable(GL_STENCIL_TEST);
+            break;
+
+            case StencilMode::MarkVolume:
+                glEnable(GL_STENCIL_TEST);
+                glStencilMask(0xFF);
+                glStencilFunc(GL_ALWAYS, 0, 0xFF);
+                glStencilOpSeparate(GL_BACK, GL_KEEP, GL_INCR_WRAP, GL_KEEP);
+                glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_DECR_WRAP, GL_KEEP);
+            break;
+
+            case StencilMode::TestVolume:
+                glEnable(GL_STENCIL_TEST);
+                glStencilMask(0xFF);
+                glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
+                glStencilOp(GL_KEEP, GL_ZERO, GL_ZERO);
+            break;
+        }
+    }
+
+    if(!previous || previous->_write_color != _write_color) {
+        const GLboolean write_color = _write_color ? GL_TRUE : GL_FALSE;
+        glColorMask(write_color, write_color, write_color, write_color);
+    }
+    if(!previous || previous->_write_depth != _write_depth) {
+        glDepthMask(_write_depth ? GL_TRUE : GL_FALSE);
+    }
+
+    if(!previous || previous->_textures != _textures) {
+        for(const auto& texture : _textures) {
+            texture.second->bind(texture.first);
+        }
+    }
+
+    const Program* program = active_program();
+    if(program == _program.get()) {
+        _program->wait();
+        if(_uniforms_pending) {
+            apply_uniforms();
+        }
+    }
+    if(!previous || previous->active_program() != program) {
+        program->bind();
     }
-    _program->bind();
 }
 
 std::shared_ptr<Material> Material::empty_material() {
@@ -116,19 +232,50 @@ std::shared_ptr<Material> Material::empty_material() {
 
 Material Material::textured_material() {
     Material material;
-    material._program = Program::from_files("deferred_prepass.frag", "basic.vert", {"TEXTURED"});
+    material._program = Program::from_files_async("deferred_prepass.frag", "basic.vert", {"TEXTURED"});
+    material._fallback_program = empty_material()->_program;
     return material;
 }
 
 Material Material::textured_normal_mapped_material() {
     Material material;
-    material._program = Program::from_files("deferred_prepass.frag", "basic.vert", std::array<std::string, 2>{"TEXTURED", "NORMAL_MAPPED"});
+    material._program = Program::from_files_async("deferred_prepass.frag", "basic.vert", std::array<std::string, 2>{"TEXTURED", "NORMAL_MAPPED"});
+    material._fallback_program = empty_material()->_program;
     return material;
 }
 
-Material Material::deferred_light(const std::string& vert, const std::string& frag) {
+Material Material::depth_only_material() {
+    Material material;
+    material._program = Program::from_files("empty.frag", "basic.vert", {"DEPTH_ONLY"});
+    material._write_color = false;
+    return material;
+}
+
+std::vector<std::shared_ptr<Program>> Material::precompile_programs() {
+    const ProgramDesc programs[] = {
+        {"deferred_prepass.frag", "basic.vert", {}},
+        {"deferred_prepass.frag", "basic.vert", {"TEXTURED"}},
+        {"deferred_prepass.frag", "basic.vert", {"TEXTURED", "NORMAL_MAPPED"}},
+        {"empty.frag", "basic.vert", {"DEPTH_ONLY"}},
+        {"deferred_sun.frag", "screen.vert", {"TEXTURED", "NORMAL_MAPPED"}},
+        {"deferred_point_light.frag", "basic.vert", {"TEXTURED", "NORMAL_MAPPED", "LIGHT_VOLUME"}},
+        {"empty.frag", "basic.vert", {"TEXTURED", "NORMAL_MAPPED", "LIGHT_VOLUME"}},
+        {"tonemap.frag", "screen.vert", {}},
+        {"imgui.frag", "imgui.vert", {}},
+        {{}, {}, {}, "exposure_histogram.comp"},
+        {{}, {}, {}, "exposure.comp"},
+        {{}, {}, {"FROM_DEPTH"}, "hiz.comp"},
+        {{}, {}, {}, "hiz.comp"},
+    };
+    return Program::precompile(programs);
+}
+
+Material Material::deferred_light(const std::string& vert, const std::string& frag, Span<const std::string> defines) {
+    std::vector<std::string> all_defines = {"TEXTURED", "NORMAL_MAPPED"};
+    all_defines.insert(all_defines.end(), defines.begin(), defines.end());
+
     Material material;
-    material._program = Program::from_files(frag, vert, std::array<std::string, 2>{"TEXTURED", "NORMAL_MAPPED"});
+    material._program = Program::from_files(frag, vert, all_defines);
     return material;
 }
 
@@ -5,6 +5,7 @@
 #include <Texture.h>
 
 #include <memory>
+#include <variant>
 #include <vector>
 
 namespace OM3D {
@@ -26,6 +27,15 @@ enum class DepthTestMode {
 enum class CullMode {
     Backface,
     Frontface,
+    None,
+};
+
+enum class StencilMode {
+    None,
+    // Counts the light volume faces behind the surface: non zero where the surface is inside the volume
+    MarkVolume,
+    // Passes where the stencil is non zero, and resets it
+    TestVolume,
 };
 
 class Material {
@@ -38,30 +48,68 @@ class Material {
         void set_depth_test_mode(DepthTestMode depth);
         void set_texture(u32 slot, std::shared_ptr<Texture> tex);
         void set_write_depth(bool write);
+        void set_write_color(bool write);
         void set_cull_mode(CullMode face);
+        void set_stencil_mode(StencilMode stencil);
 
-        template<typename... Args>
-        void set_uniform(Args&&... args) {
-            _program->set_uniform(FWD(args)...);
+        // Kept by the material: uniforms set while the program compiles are applied once it is ready.
+        // The fallback program is shared, it never gets them.
+        template<typename T>
+        void set_uniform(u32 name_hash, const T& value) {
+            set_uniform_value(name_hash, UniformValue(value));
         }
 
+        template<typename T>
+        void set_uniform(std::string_view name, const T& value) {
+            set_uniform(str_hash(name), value);
+        }
+
+        // Only sets the state that differs from previous, which must be the last material bound (or null)
+        void bind(const Material* previous = nullptr) const;
+
+        BlendMode blend_mode() const;
 
-        void bind() const;
+        // Used to sort draws: materials sharing a program, or the same set of textures, have the same id
+        u32 program_id() const;
+        u32 texture_set_id() const;
+
+        bool has_texture(u32 slot) const;
 
         static std::shared_ptr<Material> empty_material();
         static Material textured_material();
         static Material textured_normal_mapped_material();
-        static Material deferred_light(const std::string& vert, const std::string& frag);
+        // Writes the depth of geometry drawn with StaticMesh::draw_positions
+        static Material depth_only_material();
+        static Material deferred_light(const std::string& vert, const std::string& frag, Span<const std::string> defines = {});
+
+        // Starts compiling every known program permutation (compute included), keep the result alive until exit
+        static std::vector<std::shared_ptr<Program>> precompile_programs();
 
 
     private:
+        using UniformValue = std::variant<u32, float, glm::vec2, glm::uvec2, glm::vec3, glm::vec4, glm::mat2, glm::mat3, glm::mat4>;
+
+        void set_uniform_value(u32 name_hash, UniformValue value);
+        void apply_uniforms() const;
+
+        // The program bind() uses, the fallback until _program is compiled
+        const Program* active_program() const;
+
         std::shared_ptr<Program> _program;
+        // Bound instead of _program while it is being compiled
+        std::shared_ptr<Program> _fallback_program;
         std::vector<std::pair<u32, std::shared_ptr<Texture>>> _textures;
 
         BlendMode _blend_mode = BlendMode::None;
         DepthTestMode _depth_test_mode = DepthTestMode::Standard;
         bool _write_depth = true;
+        bool _write_color = true;
         CullMode _cull_mode = CullMode::Backface;
+        StencilMode _stencil_mode = StencilMode::None;
+
+        std::vector<std::pair<u32, UniformValue>> _uniforms;
+        // Set while _program was not ready, applied by the next bind()
+        mutable bool _uniforms_pending = false;
 
 };
 
@@ -0,0 +1,244 @@
+#include "MeshSimplifier.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <cmath>
+
+namespace OM3D {
+
+namespace {
+
+// Symmetric 4x4 matrix
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+    double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+    double a22 = 0.0, a23 = 0.0;
+    double a33 = 0.0;
+
+    double weight = 0.0;
+
+    static Quadric from_plane(const glm::dvec3& n, double d, double weight) {
+        Quadric q;
+        q.weight = weight;
+        q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z; q.a03 = weight * n.x * d;
+        q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a13 = weight * n.y * d;
+        q.a22 = weight * n.z * n.z; q.a23 = weight * n.z * d;
+        q.a33 = weight * d * d;
+        return q;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+        a11 += q.a11; a12 += q.a12; a13 += q.a13;
+        a22 += q.a22; a23 += q.a23;
+        a33 += q.a33;
+        weight += q.weight;
+        return *this;
+    }
+
+    // Area weighted mean of the squared distances to the planes
+    double error(const glm::vec3& p) const {
+        const double x = p.x;
+        const double y = p.y;
+        const double z = p.z;
+        const double sum = x * x * a00 + 2.0 * x * y * a01 + 2.0 * x * z * a02 + 2.0 * x * a03
+             + y * y * a11 + 2.0 * y * z * a12 + 2.0 * y * a13
+             + z * z * a22 + 2.0 * z * a23
+             + a33;
+        return weight > 0.0 ? sum / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    double cost;
+    u32 from;
+    u32 to;
+    u32 from_version;
+    u32 to_version;
+
+    bool operator<(const Collapse& other) const {
+        // Min heap
+        return cost > other.cost;
+    }
+};
+
+struct PositionHasher {
+    size_t operator()(const glm::vec3& p) const noexcept {
+        size_t h = std::hash<float>()(p.x);
+        hash_combine(h, std::hash<float>()(p.y));
+        hash_combine(h, std::hash<float>()(p.z));
+        return h;
+    }
+};
+
+}
+
+SimplifiedIndices simplify_mesh(Span<const Vertex> vertices, Span<const u32> indices, size_t target_index_count) {
+    const size_t vertex_count = vertices.size();
+    std::vector<u32> triangles(indices.begin(), indices.end());
+    const size_t triangle_count = triangles.size() / 3;
+
+    // Lock vertices sharing their position with another vertex (attribute seams) and vertices on borders
+    std::vector<bool> locked(vertex_count, false);
+    {
+        std::vector<u32> welded(vertex_count);
+        std::unordered_map<glm::vec3, u32, PositionHasher> positions;
+        for(u32 i = 0; i != vertex_count; ++i) {
+            const auto [it, inserted] = positions.emplace(vertices[i].position, i);
+            welded[i] = it->second;
+            if(!inserted) {
+                locked[i] = true;
+                locked[it->second] = true;
+            }
+        }
+
+        std::unordered_map<u64, u32> edges;
+        for(size_t i = 0; i != triangle_count * 3; ++i) {
+            const u32 a = welded[triangles[i]];
+            const u32 b = welded[triangles[i % 3 == 2 ? i - 2 : i + 1]];
+            ++edges[(u64(std::min(a, b)) << 32) | std::max(a, b)];
+        }
+        for(size_t i = 0; i != triangle_count * 3; ++i) {
+            const u32 a = welded[triangles[i]];
+            const u32 b = welded[triangles[i % 3 == 2 ? i - 2 : i + 1]];
+            if(edges[(u64(std::min(a, b)) << 32) | std::max(a, b)] == 1) {
+                locked[triangles[i]] = true;
+                locked[triangles[i % 3 == 2 ? i - 2 : i + 1]] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+    std::vector<std::vector<u32>> vertex_triangles(vertex_count);
+    for(u32 t = 0; t != triangle_count; ++t) {
+        const glm::dvec3 p0 = vertices[triangles[t * 3 + 0]].position;
+        const glm::dvec3 p1 = vertices[triangles[t * 3 + 1]].position;
+        const glm::dvec3 p2 = vertices[triangles[t * 3 + 2]].position;
+
+        const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+        const double area = glm::length(cross);
+        const glm::dvec3 normal = area > 0.0 ? cross / area : glm::dvec3(0.0);
+        const Quadric q = Quadric::from_plane(normal, -glm::dot(normal, p0), area);
+
+        for(u32 k = 0; k != 3; ++k) {
+            quadrics[triangles[t * 3 + k]] += q;
+            vertex_triangles[triangles[t * 3 + k]].push_back(t);
+        }
+    }
+
+    std::vector<bool> alive(triangle_count, true);
+    std::vector<u32> versions(vertex_count, 0);
+    std::priority_queue<Collapse> collapses;
+
+    auto push_collapse = [&](u32 from, u32 to) {
+        if(locked[from] || from == to) {
+            return;
+        }
+        Quadric q = quadrics[from];
+        q += quadrics[to];
+        collapses.push(Collapse{std::max(0.0, q.error(vertices[to].position)), from, to, versions[from], versions[to]});
+    };
+
+    for(size_t i = 0; i != triangle_count * 3; ++i) {
+        const u32 a = triangles[i];
+        const u32 b = triangles[i % 3 == 2 ? i - 2 : i + 1];
+        push_collapse(a, b);
+        push_collapse(b, a);
+    }
+
+    // Moving a vertex should not flip any of its triangles
+    auto flips = [&](u32 from, u32 to) {
+        const glm::vec3 target = vertices[to].position;
+        for(const u32 t : vertex_triangles[from]) {
+            if(!alive[t]) {
+                continue;
+            }
+            const u32* tri = &triangles[t * 3];
+            if(tri[0] == to || tri[1] == to || tri[2] == to) {
+                continue;
+            }
+
+            glm::vec3 p[3] = {vertices[tri[0]].position, vertices[tri[1]].position, vertices[tri[2]].position};
+            const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for(u32 k = 0; k != 3; ++k) {
+                if(tri[k] == from) {
+                    p[k] = target;
+                }
+            }
+            const glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if(glm::dot(before, after) <= 0.0f) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    size_t index_count = triangle_count * 3;
+    double max_error = 0.0;
+    while(index_count > target_index_count && !collapses.empty()) {
+        const Collapse collapse = collapses.top();
+        collapses.pop();
+
+        // Outdated
+        if(collapse.from_version != versions[collapse.from] || collapse.to_version != versions[collapse.to]) {
+            continue;
+        }
+
+        if(flips(collapse.from, collapse.to)) {
+            continue;
+        }
+
+        const u32 from = collapse.from;
+        const u32 to = collapse.to;
+        for(const u32 t : vertex_triangles[from]) {
+            if(!alive[t]) {
+                continue;
+            }
+            u32* tri = &triangles[t * 3];
+            for(u32 k = 0; k != 3; ++k) {
+                if(tri[k] == from) {
+                    tri[k] = to;
+                }
+            }
+            if(tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0]) {
+                alive[t] = false;
+                index_count -= 3;
+            } else {
+                vertex_triangles[to].push_back(t);
+            }
+        }
+
+        vertex_triangles[from].clear();
+        quadrics[to] += quadrics[from];
+        max_error = std::max(max_error, collapse.cost);
+
+        // Invalidate every collapse involving the merged vertices
+        ++versions[from];
+        ++versions[to];
+        for(const u32 t : vertex_triangles[to]) {
+            if(!alive[t]) {
+                continue;
+            }
+            for(u32 k = 0; k != 3; ++k) {
+                const u32 other = triangles[t * 3 + k];
+                push_collapse(to, other);
+                push_collapse(other, to);
+            }
+        }
+    }
+
+    SimplifiedIndices result;
+    result.indices.reserve(index_count);
+    for(u32 t = 0; t != triangle_count; ++t) {
+        if(alive[t]) {
+            result.indices.insert(result.indices.end(), &triangles[t * 3], &triangles[t * 3] + 3);
+        }
+    }
+    result.error = float(std::sqrt(max_error));
+    return result;
+}
+
+}
@@ -0,0 +1,24 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <Vertex.h>
+#include <utils.h>
+
+#include <vector>
+
+namespace OM3D {
+
+struct SimplifiedIndices {
+    std::vector<u32> indices;
+
+    // Biggest error of the collapses (RMS distance to the original planes), in mesh units
+    float error = 0.0f;
+};
+
+// Quadric error edge collapse: vertices are collapsed onto their neighbors, so the result indexes the same vertices.
+// Vertices on borders and attribute seams are never moved.
+SimplifiedIndices simplify_mesh(Span<const Vertex> vertices, Span<const u32> indices, size_t target_index_count);
+
+}
+
+#endif // MESHSIMPLIFIER_H
@@ -0,0 +1,460 @@
+#include "MeshoptDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace OM3D {
+
+static constexpr u8 vertex_header = 0xa0;
+static constexpr u8 triangle_header = 0xe0;
+static constexpr u8 sequence_header = 0xd0;
+
+static constexpr size_t byte_group_size = 16;
+// Biggest group: 8 bytes of 4-bit codes and 16 escaped bytes
+static constexpr size_t byte_group_max_bytes = 24;
+static constexpr size_t vertex_block_max_bytes = 8192;
+static constexpr size_t vertex_block_max_size = 256;
+static constexpr size_t vertex_tail_min_size = 32;
+
+
+static u8 unzigzag8(u8 v) {
+    return u8(-(v & 1) ^ (v >> 1));
+}
+
+static u32 unzigzag32(u32 v) {
+    return u32(-i32(v & 1)) ^ (v >> 1);
+}
+
+// Groups of 16 bytes, stored with 0, 2, 4 or 8 bits per byte. In the 2 and 4 bits forms, all bits set means
+// that the byte follows the codes.
+template<u32 bits>
+static const u8* decode_byte_group_bits(const u8* data, u8* out) {
+    const u8* escaped = data + byte_group_size * bits / 8;
+    for(size_t i = 0; i != byte_group_size * bits / 8; ++i) {
+        u8 byte = data[i];
+        for(u32 j = 0; j != 8 / bits; ++j) {
+            const u8 code = u8(byte >> (8 - bits));
+            byte = u8(byte << bits);
+
+            const bool escape = code == (1 << bits) - 1;
+            *out++ = escape ? *escaped : code;
+            escaped += escape;
+        }
+    }
+    return escaped;
+}
+
+static const u8* decode_bytes(const u8* data, const u8* data_end, u8* out, size_t size) {
+    // 2 bits per group
+    const u8* header = data;
+    const size_t header_size = (size / byte_group_size + 3) / 4;
+    if(size_t(data_end - data) < header_size) {
+        return nullptr;
+    }
+    data += header_size;
+
+    for(size_t i = 0; i != size; i += byte_group_size) {
+        // Also ensures that groups never read past the end
+        if(size_t(data_end - data) < byte_group_max_bytes) {
+            return nullptr;
+        }
+
+        const size_t group = i / byte_group_size;
+        switch((header[group / 4] >> ((group % 4) * 2)) & 3) {
+            case 0:
+                std::memset(out + i, 0, byte_group_size);
+            break;
+
+            case 1:
+                data = decode_byte_group_bits<2>(data, out + i);
+            break;
+
+            case 2:
+                data = decode_byte_group_bits<4>(data, out + i);
+            break;
+
+            default:
+                std::memcpy(out + i, data, byte_group_size);
+                data += byte_group_size;
+        }
+    }
+    return data;
+}
+
+// Every byte of the vertex is stored separately, as a zigzag delta to the same byte of the previous vertex
+static const u8* decode_vertex_block(const u8* data, const u8* data_end, u8* out, size_t count, size_t stride, u8* last_vertex) {
+    u8 deltas[vertex_block_max_size];
+    const size_t aligned_count = (count + byte_group_size - 1) & ~(byte_group_size - 1);
+
+    for(size_t k = 0; k != stride; ++k) {
+        data = decode_bytes(data, data_end, deltas, aligned_count);
+        if(!data) {
+            return nullptr;
+        }
+
+        u8 previous = last_vertex[k];
+        for(size_t i = 0; i != count; ++i) {
+            previous = u8(previous + unzigzag8(deltas[i]));
+            out[i * stride + k] = previous;
+        }
+        last_vertex[k] = previous;
+    }
+    return data;
+}
+
+bool decode_meshopt_vertices(u8* destination, size_t count, size_t stride, Span<const u8> encoded) {
+    if(!stride || stride % 4 || stride > vertex_block_max_size) {
+        return false;
+    }
+
+    const u8* data = encoded.data();
+    const u8* data_end = data + encoded.size();
+
+    if(encoded.size() < 1 + stride || data[0] != vertex_header) {
+        return false;
+    }
+    ++data;
+
+    // The tail is padding followed by the first vertex, which is the base of the first deltas
+    const size_t tail_size = std::max(stride, vertex_tail_min_size);
+    if(size_t(data_end - data) < tail_size) {
+        return false;
+    }
+
+    u8 last_vertex[vertex_block_max_size];
+    std::memcpy(last_vertex, data_end - stride, stride);
+
+    const size_t block_size = std::min(vertex_block_max_bytes / stride & ~(byte_group_size - 1), vertex_block_max_size);
+    for(size_t offset = 0; offset < count; offset += block_size) {
+        data = decode_vertex_block(data, data_end, destination + offset * stride, std::min(block_size, count - offset), stride, last_vertex);
+        if(!data) {
+            return false;
+        }
+    }
+
+    return size_t(data_end - data) == tail_size;
+}
+
+
+static void write_index(u8* destination, size_t i, size_t stride, u32 index) {
+    if(stride == 2) {
+        const u16 short_index = u16(index);
+        std::memcpy(destination + i * 2, &short_index, 2);
+    } else {
+        std::memcpy(destination + i * 4, &index, 4);
+    }
+}
+
+static u32 decode_vbyte(const u8*& data) {
+    const u8 lead = *data++;
+    if(lead < 128) {
+        return lead;
+    }
+
+    // At most 4 more bytes, even if the data is malformed
+    u32 result = lead & 127;
+    u32 shift = 7;
+    for(u32 i = 0; i != 4; ++i) {
+        const u8 group = *data++;
+        result |= u32(group & 127) << shift;
+        shift += 7;
+        if(group < 128) {
+            break;
+        }
+    }
+    return result;
+}
+
+static u32 decode_index(const u8*& data, u32 last) {
+    return last + unzigzag32(decode_vbyte(data));
+}
+
+// Triangles are encoded relative to a FIFO of recent edges and one of recent vertices,
+// the decoder has to update them exactly like the encoder did.
+bool decode_meshopt_triangles(u8* destination, size_t count, size_t stride, Span<const u8> encoded) {
+    if(count % 3 || (stride != 2 && stride != 4)) {
+        return false;
+    }
+
+    // Header, a code per triangle and a 16 entries table at the end
+    const size_t triangle_count = count / 3;
+    if(encoded.size() < 1 + triangle_count + 16) {
+        return false;
+    }
+
+    const u8* buffer = encoded.data();
+    if((buffer[0] & 0xf0) != triangle_header || (buffer[0] & 0x0f) > 1) {
+        return false;
+    }
+    // Version 1 encodes the last index +/-1 with two vertex FIFO slots
+    const u32 max_fifo_code = (buffer[0] & 0x0f) >= 1 ? 13 : 15;
+
+    u32 edge_fifo[16][2];
+    u32 vertex_fifo[16];
+    std::memset(edge_fifo, 0xff, sizeof(edge_fifo));
+    std::memset(vertex_fifo, 0xff, sizeof(vertex_fifo));
+    u32 edge_offset = 0;
+    u32 vertex_offset = 0;
+
+    const auto push_edge = [&](u32 a, u32 b) {
+        edge_fifo[edge_offset][0] = a;
+        edge_fifo[edge_offset][1] = b;
+        edge_offset = (edge_offset + 1) & 15;
+    };
+    const auto push_vertex = [&](u32 v, bool cond = true) {
+        vertex_fifo[vertex_offset] = v;
+        vertex_offset = (vertex_offset + cond) & 15;
+    };
+
+    u32 next = 0;
+    u32 last = 0;
+
+    const u8* code = buffer + 1;
+    const u8* data = code + triangle_count;
+    const u8* data_safe_end = buffer + encoded.size() - 16;
+    const u8* code_aux_table = data_safe_end;
+
+    for(size_t i = 0; i != count; i += 3) {
+        // A triangle reads at most 16 bytes, which the table at the end covers
+        if(data > data_safe_end) {
+            return false;
+        }
+
+        const u8 code_tri = *code++;
+
+        if(code_tri < 0xf0) {
+            // Edge from the FIFO, third vertex from the FIFO, new or explicit
+            const u32* edge = edge_fifo[(edge_offset - 1 - (code_tri >> 4)) & 15];
+            const u32 a = edge[0];
+            const u32 b = edge[1];
+            const u32 fec = code_tri & 15;
+
+            u32 c = 0;
+            if(fec < max_fifo_code) {
+                c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - 1 - fec) & 15];
+                push_vertex(c, fec == 0);
+            } else {
+                // 13 and 14 are last - 1 and last + 1
+                last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decode_index(data, last);
+                push_vertex(c);
+            }
+
+            write_index(destination, i + 0, stride, a);
+            write_index(destination, i + 1, stride, b);
+            write_index(destination, i + 2, stride, c);
+
+            push_edge(c, b);
+            push_edge(a, c);
+        } else {
+            // No shared edge
+            u32 a = 0;
+            u32 b = 0;
+            u32 c = 0;
+            u32 feb = 0;
+            u32 fec = 0;
+
+            if(code_tri < 0xfe) {
+                const u8 code_aux = code_aux_table[code_tri & 15];
+                feb = code_aux >> 4;
+                fec = code_aux & 15;
+
+                // The table never contains 15
+                a = next++;
+                b = feb == 0 ? next++ : vertex_fifo[(vertex_offset - feb) & 15];
+                c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - fec) & 15];
+            } else {
+                const u8 code_aux = *data++;
+                const u32 fea = code_tri == 0xfe ? 0 : 15;
+                feb = code_aux >> 4;
+                fec = code_aux & 15;
+
+                if(code_aux == 0) {
+                    next = 0;
+                }
+
+                a = fea == 0 ? next++ : 0;
+                b = feb == 0 ? next++ : vertex_fifo[(vertex_offset - feb) & 15];
+                c = fec == 0 ? next++ : vertex_fifo[(vertex_offset - fec) & 15];
+
+                if(fea == 15) {
+                    last = a = decode_index(data, last);
+                }
+                if(feb == 15) {
+                    last = b = decode_index(data, last);
+                }
+                if(fec == 15) {
+                    last = c = decode_index(data, last);
+                }
+            }
+
+            write_index(destination, i + 0, stride, a);
+            write_index(destination, i + 1, stride, b);
+            write_index(destination, i + 2, stride, c);
+
+            push_vertex(a);
+            push_vertex(b, feb == 0 || feb == 15);
+            push_vertex(c, fec == 0 || fec == 15);
+
+            push_edge(b, a);
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+    }
+
+    // Everything up to the table must have been read
+    return data == data_safe_end;
+}
+
+// Zigzag deltas against one of two previous indices, selected by the low bit
+bool decode_meshopt_indices(u8* destination, size_t count, size_t stride, Span<const u8> encoded) {
+    if(stride != 2 && stride != 4) {
+        return false;
+    }
+
+    // Header, at least a byte per index and a 4 bytes tail
+    if(encoded.size() < 1 + count + 4) {
+        return false;
+    }
+
+    const u8* buffer = encoded.data();
+    if((buffer[0] & 0xf0) != sequence_header || (buffer[0] & 0x0f) > 1) {
+        return false;
+    }
+
+    const u8* data = buffer + 1;
+    const u8* data_safe_end = buffer + encoded.size() - 4;
+
+    u32 last[2] = {};
+    for(size_t i = 0; i != count; ++i) {
+        // An index reads at most 5 bytes, which the tail covers
+        if(data >= data_safe_end) {
+            return false;
+        }
+
+        const u32 v = decode_vbyte(data);
+        const u32 base = v & 1;
+        last[base] += unzigzag32(v >> 1);
+        write_index(destination, i, stride, last[base]);
+    }
+
+    return data == data_safe_end;
+}
+
+
+static float round_away(float x) {
+    return x + (x >= 0.0f ? 0.5f : -0.5f);
+}
+
+// Signed normalized octahedral xy with the value of 1 in z, w is left as is
+template<typename T>
+static void decode_octahedral(u8* data, size_t count, size_t stride) {
+    const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+    for(size_t i = 0; i != count; ++i) {
+        T v[4];
+        std::memcpy(v, data + i * stride, sizeof(v));
+
+        float x = float(v[0]);
+        float y = float(v[1]);
+        const float z = float(v[2]) - std::abs(x) - std::abs(y);
+
+        // Fold back the lower hemisphere
+        const float t = std::min(z, 0.0f);
+        x += x >= 0.0f ? t : -t;
+        y += y >= 0.0f ? t : -t;
+
+        const float scale = max / std::sqrt(x * x + y * y + z * z);
+        v[0] = T(round_away(x * scale));
+        v[1] = T(round_away(y * scale));
+        v[2] = T(round_away(z * scale));
+
+        std::memcpy(data + i * stride, v, sizeof(v));
+    }
+}
+
+// Three smallest components, the index of the biggest one in the low 2 bits of w and the scale above them
+static void decode_quaternion(u8* data, size_t count) {
+    const float scale = 1.0f / std::sqrt(2.0f);
+    for(size_t i = 0; i != count; ++i) {
+        i16 v[4];
+        std::memcpy(v, data + i * 8, sizeof(v));
+
+        const float s = scale / float(v[3] | 3);
+        const float x = float(v[0]) * s;
+        const float y = float(v[1]) * s;
+        const float z = float(v[2]) * s;
+        const float w = std::sqrt(std::max(0.0f, 1.0f - x * x - y * y - z * z));
+
+        const u32 max_component = v[3] & 3;
+        i16 q[4];
+        q[(max_component + 1) & 3] = i16(round_away(x * 32767.0f));
+        q[(max_component + 2) & 3] = i16(round_away(y * 32767.0f));
+        q[(max_component + 3) & 3] = i16(round_away(z * 32767.0f));
+        q[max_component] = i16(w * 32767.0f + 0.5f);
+
+        std::memcpy(data + i * 8, q, sizeof(q));
+    }
+}
+
+// 24 bits signed mantissa and 8 bits signed exponent
+static void decode_exponential(u8* data, size_t count) {
+    for(size_t i = 0; i != count; ++i) {
+        u32 v = 0;
+        std::memcpy(&v, data + i * 4, 4);
+
+        const i32 mantissa = i32(v << 8) >> 8;
+        const i32 exponent = i32(v) >> 24;
+        const float f = std::ldexp(float(mantissa), exponent);
+
+        std::memcpy(data + i * 4, &f, 4);
+    }
+}
+
+bool apply_meshopt_filter(MeshoptFilter filter, u8* data, size_t count, size_t stride) {
+    switch(filter) {
+        case MeshoptFilter::None:
+            return true;
+
+        case MeshoptFilter::Octahedral:
+            if(stride == 4) {
+                decode_octahedral<i8>(data, count, stride);
+                return true;
+            }
+            if(stride == 8) {
+                decode_octahedral<i16>(data, count, stride);
+                return true;
+            }
+            return false;
+
+        case MeshoptFilter::Quaternion:
+            if(stride != 8) {
+                return false;
+            }
+            decode_quaternion(data, count);
+            return true;
+
+        case MeshoptFilter::Exponential:
+            if(stride % 4) {
+                return false;
+            }
+            decode_exponential(data, count * stride / 4);
+            return true;
+    }
+    return false;
+}
+
+bool decode_meshopt(MeshoptMode mode, MeshoptFilter filter, u8* destination, size_t count, size_t stride, Span<const u8> encoded) {
+    switch(mode) {
+        case MeshoptMode::Attributes:
+            return decode_meshopt_vertices(destination, count, stride, encoded) && apply_meshopt_filter(filter, destination, count, stride);
+
+        case MeshoptMode::Triangles:
+            return filter == MeshoptFilter::None && decode_meshopt_triangles(destination, count, stride, encoded);
+
+        case MeshoptMode::Indices:
+            return filter == MeshoptFilter::None && decode_meshopt_indices(destination, count, stride, encoded);
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,41 @@
+#ifndef MESHOPTDECODER_H
+#define MESHOPTDECODER_H
+
+#include <utils.h>
+
+namespace OM3D {
+
+// Decoders for the EXT_meshopt_compression bitstreams (vertex codec version 0, index codecs version 0 and 1).
+// They write count * stride bytes to destination and return false on malformed data.
+
+enum class MeshoptMode {
+    Attributes,
+    Triangles,
+    Indices,
+};
+
+enum class MeshoptFilter {
+    None,
+    Octahedral,
+    Quaternion,
+    Exponential,
+};
+
+// stride must be a multiple of 4, at most 256
+bool decode_meshopt_vertices(u8* destination, size_t count, size_t stride, Span<const u8> encoded);
+
+// count must be a multiple of 3, stride 2 or 4
+bool decode_meshopt_triangles(u8* destination, size_t count, size_t stride, Span<const u8> encoded);
+
+// stride 2 or 4
+bool decode_meshopt_indices(u8* destination, size_t count, size_t stride, Span<const u8> encoded);
+
+// In place, on decoded attributes. False if the filter does not support the stride.
+bool apply_meshopt_filter(MeshoptFilter filter, u8* data, size_t count, size_t stride);
+
+// Decodes and filters one buffer view
+bool decode_meshopt(MeshoptMode mode, MeshoptFilter filter, u8* destination, size_t count, size_t stride, Span<const u8> encoded);
+
+}
+
+#endif // MESHOPTDECODER_H
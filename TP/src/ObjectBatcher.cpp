@@ -1,32 +1,78 @@
 #include "ObjectBatcher.h"
 
+#include "AllocationTracker.h"
+
+#include <algorithm>
 #include <iostream>
 
 namespace OM3D
 {
-   void ObjectBatcher::add_object(const SceneObject& object) {
-        auto material = object.get_material();
-        auto batch = _batches.find(material);
-        if (batch == _batches.end()) {
-            Batch new_batch;
-            new_batch.models.push_back(object.transform());
-            new_batch.mesh = object.get_mesh();
-            _batches.insert({ material, new_batch });
+   size_t ObjectBatcher::BatchKeyHash::operator()(const BatchKey& key) const {
+        size_t hash = key.material.value();
+        hash_combine(hash, size_t(key.mesh.value()));
+        hash_combine(hash, size_t(key.lod));
+        return hash;
+   }
+
+   void ObjectBatcher::add_object(const SceneObject& object, u32 lod, float depth) {
+        add_object(object.material_handle(), object.mesh_handle(), object.transform(), lod, depth);
+   }
+
+   void ObjectBatcher::add_object(MaterialHandle material, MeshHandle mesh, const glm::mat4& transform, u32 lod, float depth) {
+        const BatchKey key{material, mesh, lod};
+
+        Batch& batch = _batches[key];
+        if (batch.models.empty()) {
+            batch.material = material;
+            batch.mesh = mesh;
+            batch.lod = lod;
+            batch.depth = depth;
         }
-        else
-            batch->second.models.push_back(object.transform());
+        batch.depth = std::min(batch.depth, depth);
+        batch.models.push_back(transform);
    }
 
-   void ObjectBatcher::render() const {
-        for (auto pair : _batches) {
-            auto material = pair.first;
-            Batch batch = pair.second;
+   void ObjectBatcher::record(CommandBuffer& commands, DrawMode opaque_mode) const {
+        record(commands, commands, opaque_mode);
+   }
+
+   void ObjectBatcher::record(CommandBuffer& opaque_commands, CommandBuffer& transparent_commands, DrawMode opaque_mode) const {
+        for (const auto& pair : _batches) {
+            const Batch& batch = pair.second;
 
-            TypedBuffer<glm::mat4> model_buffer(batch.models.data(), batch.models.size());
-            model_buffer.bind(BufferUsage::Storage, 2);
+            const Material* material = ResourcePool<Material>::global().get(batch.material);
+            const StaticMesh* mesh = ResourcePool<StaticMesh>::global().get(batch.mesh);
+            if (!material || !mesh)
+                continue;
 
-            material->bind();
-            batch.mesh->draw(int(batch.models.size()));
+            const bool opaque = material->blend_mode() == BlendMode::None;
+            const u64 key = draw_sort_key(opaque ? DrawPass::Opaque : DrawPass::Transparent, *material, batch.mesh.value(), batch.depth);
+            if (opaque)
+                opaque_commands.draw_mesh(key, material, mesh, batch.lod, batch.models, opaque_mode);
+            else
+                transparent_commands.draw_mesh(key, material, mesh, batch.lod, batch.models);
         }
    }
+
+   void ObjectBatcher::record_depth(CommandBuffer& commands, const Material& depth_material) const {
+        for (const auto& pair : _batches) {
+            const Batch& batch = pair.second;
+
+            const Material* material = ResourcePool<Material>::global().get(batch.material);
+            const StaticMesh* mesh = ResourcePool<StaticMesh>::global().get(batch.mesh);
+            if (!material || !mesh || material->blend_mode() != BlendMode::None)
+                continue;
+
+            const u64 key = draw_sort_key(DrawPass::Opaque, *material, batch.mesh.value(), batch.depth);
+            commands.draw_mesh(key, &depth_material, mesh, batch.lod, batch.models, DrawMode::DepthOnly);
+        }
+   }
+
+   void ObjectBatcher::render() const {
+        ALLOCATION_SCOPE("ObjectBatcher::render");
+
+        CommandBuffer commands;
+        record(commands);
+        commands.submit();
+   }
 } // namespace OM3D
@@ -1,22 +1,51 @@
 #pragma once
 
-#include <unordered_map>
-
 #include "SceneObject.h"
+#include "FrameAllocator.h"
+#include "CommandBuffer.h"
 
 namespace OM3D
 {
+    // Only lives for a frame: everything is allocated from the frame allocator
     class ObjectBatcher {
     public:
         struct Batch {
-            std::vector<glm::mat4> models;
-            std::shared_ptr<StaticMesh> mesh;
+            FrameVector<glm::mat4> models;
+            MaterialHandle material;
+            MeshHandle mesh;
+            u32 lod = 0;
+            // View depth of the closest object, to draw batches front to back
+            float depth = 0.0f;
         };
 
-        void add_object(const SceneObject& object);
+        void add_object(const SceneObject& object, u32 lod = 0, float depth = 0.0f);
+        void add_object(MaterialHandle material, MeshHandle mesh, const glm::mat4& transform, u32 lod = 0, float depth = 0.0f);
+        // One instanced draw per batch, sorted with draw_sort_key. Does not touch GL so it can run on any thread.
+        // opaque_mode only applies to opaque batches, use DrawMode::DepthEqual after record_depth.
+        void record(CommandBuffer& commands, DrawMode opaque_mode = DrawMode::Standard) const;
+        // Same, with the transparent batches in their own buffer (they are sorted after every opaque draw)
+        void record(CommandBuffer& opaque_commands, CommandBuffer& transparent_commands, DrawMode opaque_mode = DrawMode::Standard) const;
+        // Depth prepass: the opaque batches with depth_material, from their position stream.
+        // Sorted like the opaque draws of record, so both test the same fragments in the same order.
+        void record_depth(CommandBuffer& commands, const Material& depth_material) const;
+        // Records and submits, GL thread only
         void render() const;
 
     private:
-        std::unordered_map<std::shared_ptr<Material>, Batch> _batches;
+        struct BatchKey {
+            MaterialHandle material;
+            MeshHandle mesh;
+            u32 lod;
+
+            bool operator==(const BatchKey& other) const {
+                return material == other.material && mesh == other.mesh && lod == other.lod;
+            }
+        };
+
+        struct BatchKeyHash {
+            size_t operator()(const BatchKey& key) const;
+        };
+
+        FrameHashMap<BatchKey, Batch, BatchKeyHash> _batches;
     };
 } // namespace OM3D
@@ -0,0 +1,219 @@
+#include "OcclusionRasterizer.h"
+
+#include <Camera.h>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace OM3D {
+
+OcclusionRasterizer::OcclusionRasterizer(const glm::uvec2& size) : _size(size), _depth(size.x * size.y, 0.0f) {
+    ALWAYS_ASSERT(size.x % 4 == 0 && size.y, "Invalid occlusion buffer size");
+}
+
+void OcclusionRasterizer::begin(const glm::mat4& view_proj) {
+    _view_proj = view_proj;
+    _triangles.clear();
+    std::fill(_depth.begin(), _depth.end(), 0.0f);
+}
+
+void OcclusionRasterizer::add_occluder(const OccluderMesh& mesh, const glm::mat4& model) {
+    const glm::mat4 transform = _view_proj * model;
+
+    _clip_positions.resize(mesh.positions.size());
+    {
+#ifdef SIMD_SSE2
+        const __m128 col0 = _mm_loadu_ps(&transform[0][0]);
+        const __m128 col1 = _mm_loadu_ps(&transform[1][0]);
+        const __m128 col2 = _mm_loadu_ps(&transform[2][0]);
+        const __m128 col3 = _mm_loadu_ps(&transform[3][0]);
+        for(size_t i = 0; i != mesh.positions.size(); ++i) {
+            const glm::vec3& pos = mesh.positions[i];
+            __m128 clip = _mm_add_ps(col3, _mm_mul_ps(col0, _mm_set1_ps(pos.x)));
+            clip = _mm_add_ps(clip, _mm_mul_ps(col1, _mm_set1_ps(pos.y)));
+            clip = _mm_add_ps(clip, _mm_mul_ps(col2, _mm_set1_ps(pos.z)));
+            _mm_storeu_ps(&_clip_positions[i].x, clip);
+        }
+#else
+        for(size_t i = 0; i != mesh.positions.size(); ++i) {
+            _clip_positions[i] = transform * glm::vec4(mesh.positions[i], 1.0f);
+        }
+#endif
+    }
+
+    const glm::vec2 screen_size(_size);
+    for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+        glm::vec3 verts[3];
+        bool clipped = false;
+        for(u32 k = 0; k != 3; ++k) {
+            const glm::vec4& clip = _clip_positions[mesh.indices[i + k]];
+            // Behind the camera or the near plane: skipping the triangle is conservative
+            if(clip.w <= 0.0f || clip.z > clip.w) {
+                clipped = true;
+                break;
+            }
+            const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            verts[k] = glm::vec3((glm::vec2(ndc) * 0.5f + 0.5f) * screen_size, ndc.z);
+        }
+
+        if(clipped) {
+            continue;
+        }
+
+        const float area = (verts[1].x - verts[0].x) * (verts[2].y - verts[0].y) - (verts[1].y - verts[0].y) * (verts[2].x - verts[0].x);
+        if(area <= 0.0f) {
+            // Back facing (CCW is front facing) or degenerate
+            continue;
+        }
+
+        Triangle tri;
+        tri.min = glm::max(glm::ivec2(glm::floor(glm::min(glm::min(glm::vec2(verts[0]), glm::vec2(verts[1])), glm::vec2(verts[2])))), glm::ivec2(0));
+        tri.max = glm::min(glm::ivec2(glm::ceil(glm::max(glm::max(glm::vec2(verts[0]), glm::vec2(verts[1])), glm::vec2(verts[2])))), glm::ivec2(_size) - 1);
+        if(tri.min.x > tri.max.x || tri.min.y > tri.max.y) {
+            continue;
+        }
+
+        tri.depth_a = 0.0f;
+        tri.depth_b = 0.0f;
+        tri.depth_c = 0.0f;
+        for(u32 k = 0; k != 3; ++k) {
+            const glm::vec3& a = verts[k];
+            const glm::vec3& b = verts[(k + 1) % 3];
+            tri.edge_a[k] = a.y - b.y;
+            tri.edge_b[k] = b.x - a.x;
+            tri.edge_c[k] = a.x * b.y - a.y * b.x;
+
+            // The edge opposite to a vertex gives its barycentric coordinate
+            const float opposite_depth = verts[(k + 2) % 3].z / area;
+            tri.depth_a += tri.edge_a[k] * opposite_depth;
+            tri.depth_b += tri.edge_b[k] * opposite_depth;
+            tri.depth_c += tri.edge_c[k] * opposite_depth;
+        }
+
+        _triangles.push_back(tri);
+    }
+}
+
+void OcclusionRasterizer::rasterize(ThreadPool& pool) {
+    const u32 tiles_x = align_up_to(_size.x, tile_width) / tile_width;
+    const u32 tiles_y = align_up_to(_size.y, tile_height) / tile_height;
+    pool.parallel_for(tiles_x * tiles_y, [&](size_t tile) { rasterize_tile(u32(tile)); });
+}
+
+void OcclusionRasterizer::rasterize_tile(u32 tile) {
+    const u32 tiles_x = align_up_to(_size.x, tile_width) / tile_width;
+    const glm::ivec2 tile_min(i32((tile % tiles_x) * tile_width), i32((tile / tiles_x) * tile_height));
+    const glm::ivec2 tile_max = glm::min(tile_min + glm::ivec2(tile_width, tile_height), glm::ivec2(_size)) - 1;
+
+    for(const Triangle& tri : _triangles) {
+        const glm::ivec2 min = glm::max(tri.min, tile_min);
+        const glm::ivec2 max = glm::min(tri.max, tile_max);
+        if(min.x > max.x || min.y > max.y) {
+            continue;
+        }
+
+        // Process pixels 4 by 4, the width is a multiple of 4 so we never write outside of the row
+        const i32 first_x = min.x & ~3;
+
+#ifdef SIMD_SSE2
+        const __m128 pixel_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 edge_a0 = _mm_set1_ps(tri.edge_a[0]);
+        const __m128 edge_a1 = _mm_set1_ps(tri.edge_a[1]);
+        const __m128 edge_a2 = _mm_set1_ps(tri.edge_a[2]);
+        const __m128 depth_a = _mm_set1_ps(tri.depth_a);
+
+        for(i32 y = min.y; y <= max.y; ++y) {
+            const float py = float(y) + 0.5f;
+            const __m128 row0 = _mm_set1_ps(tri.edge_b[0] * py + tri.edge_c[0]);
+            const __m128 row1 = _mm_set1_ps(tri.edge_b[1] * py + tri.edge_c[1]);
+            const __m128 row2 = _mm_set1_ps(tri.edge_b[2] * py + tri.edge_c[2]);
+            const __m128 row_depth = _mm_set1_ps(tri.depth_b * py + tri.depth_c);
+
+            float* row = _depth.data() + y * _size.x;
+            for(i32 x = first_x; x <= max.x; x += 4) {
+                const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), pixel_offsets);
+
+                const __m128 e0 = _mm_add_ps(_mm_mul_ps(edge_a0, px), row0);
+                const __m128 e1 = _mm_add_ps(_mm_mul_ps(edge_a1, px), row1);
+                const __m128 e2 = _mm_add_ps(_mm_mul_ps(edge_a2, px), row2);
+                const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+
+                // Depth is >= 0 so masked out pixels keep their depth
+                const __m128 depth = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(depth_a, px), row_depth));
+                _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), depth));
+            }
+        }
+#else
+        for(i32 y = min.y; y <= max.y; ++y) {
+            const float py = float(y) + 0.5f;
+            float* row = _depth.data() + y * _size.x;
+            for(i32 x = first_x; x <= max.x; ++x) {
+                const float px = float(x) + 0.5f;
+                bool inside = true;
+                for(u32 k = 0; k != 3; ++k) {
+                    inside &= tri.edge_a[k] * px + tri.edge_b[k] * py + tri.edge_c[k] >= 0.0f;
+                }
+                if(inside) {
+                    row[x] = std::max(row[x], tri.depth_a * px + tri.depth_b * py + tri.depth_c);
+                }
+            }
+        }
+#endif
+    }
+}
+
+bool OcclusionRasterizer::is_occluded(const BoundingSphere& sphere) const {
+    const glm::vec3 extent(sphere.radius);
+    return is_occluded(sphere.center - extent, sphere.center + extent);
+}
+
+bool OcclusionRasterizer::is_occluded(const glm::vec3& box_min, const glm::vec3& box_max) const {
+    const auto bounds = project_box(_view_proj, box_min, box_max);
+    if(!bounds.is_ok) {
+        return false;
+    }
+
+    const glm::vec2 screen_size(_size);
+    const glm::ivec2 min = glm::min(glm::ivec2(bounds.value.min_uv * screen_size), glm::ivec2(_size) - 1);
+    const glm::ivec2 max = glm::min(glm::ivec2(bounds.value.max_uv * screen_size), glm::ivec2(_size) - 1);
+    const float nearest = bounds.value.nearest_depth;
+
+    for(i32 y = min.y; y <= max.y; ++y) {
+        const float* row = _depth.data() + y * _size.x;
+        i32 x = min.x;
+#ifdef SIMD_SSE2
+        const __m128 nearest_depth = _mm_set1_ps(nearest);
+        for(; x + 3 <= max.x; x += 4) {
+            if(_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), nearest_depth))) {
+                return false;
+            }
+        }
+#endif
+        for(; x <= max.x; ++x) {
+            if(row[x] <= nearest) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+const glm::uvec2& OcclusionRasterizer::size() const {
+    return _size;
+}
+
+size_t OcclusionRasterizer::triangle_count() const {
+    return _triangles.size();
+}
+
+Span<const float> OcclusionRasterizer::depth() const {
+    return _depth;
+}
+
+}
@@ -0,0 +1,66 @@
+#ifndef OCCLUSIONRASTERIZER_H
+#define OCCLUSIONRASTERIZER_H
+
+#include <StaticMesh.h>
+#include <ThreadPool.h>
+
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+// CPU depth-only rasterizer used for occlusion culling when no GPU read back is possible.
+// Depth uses reverse-Z like the GPU passes: cleared to 0, nearest depth kept.
+class OcclusionRasterizer : NonMovable {
+    struct Triangle {
+        // Edge functions: inside if edge_a * x + edge_b * y + edge_c >= 0 for all edges
+        float edge_a[3];
+        float edge_b[3];
+        float edge_c[3];
+
+        // Depth plane: depth_a * x + depth_b * y + depth_c
+        float depth_a;
+        float depth_b;
+        float depth_c;
+
+        glm::ivec2 min;
+        glm::ivec2 max;
+    };
+
+    public:
+        static constexpr u32 tile_width = 64;
+        static constexpr u32 tile_height = 32;
+
+        // Width should be a multiple of 4
+        OcclusionRasterizer(const glm::uvec2& size = glm::uvec2(256, 128));
+
+        // Clear the depth and the occluder list
+        void begin(const glm::mat4& view_proj);
+
+        void add_occluder(const OccluderMesh& mesh, const glm::mat4& model);
+
+        // Rasterize every occluder added since begin, screen tiles are processed in parallel
+        void rasterize(ThreadPool& pool = ThreadPool::global());
+
+        bool is_occluded(const BoundingSphere& sphere) const;
+        bool is_occluded(const glm::vec3& box_min, const glm::vec3& box_max) const;
+
+        const glm::uvec2& size() const;
+        size_t triangle_count() const;
+        Span<const float> depth() const;
+
+    private:
+        void rasterize_tile(u32 tile);
+
+        glm::uvec2 _size;
+        glm::mat4 _view_proj = glm::mat4(1.0f);
+
+        std::vector<float> _depth;
+        std::vector<Triangle> _triangles;
+        std::vector<glm::vec4> _clip_positions;
+};
+
+}
+
+#endif // OCCLUSIONRASTERIZER_H
@@ -1,88 +1,43 @@
 #include "Program.h"
 
+#include <ShaderPreprocessor.h>
+
 #include <glad/glad.h>
 
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
 #include <algorithm>
-#include <unordered_set>
 #include <unordered_map>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <deque>
+#include <iostream>
 
-namespace OM3D {
-
-static std::string read_shader(const std::string& file_name, Span<const std::string> defines = {}) {
-    auto content = read_text_file(std::string(shader_path) + file_name);
-    if (!content.is_ok) {
-        FATAL((std::string("Unable to read shader: \"") + std::string(shader_path) + '"').c_str());
-    }
-
-    bool define_added = false;
-    auto add_defines = [&]() {
-        if(define_added || defines.is_empty()) {
-            return std::string();
-        }
-        define_added = true;
-        std::string defs = "\n";
-        for(const std::string& def : defines) {
-            defs += "#define " + def + " 1\n";
-        }
-        return defs;
-    };
+// From GL_KHR_parallel_shader_compile (shared with GL_ARB_parallel_shader_compile)
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
 
-    std::string shader(std::move(content.value));
-    std::unordered_set<std::string> includes;
-    for(size_t i = 0; i < shader.size();) {
-        const auto endl = shader.find('\n', i);
-        if(endl == std::string::npos) {
-            break;
-        }
-
-        const std::string_view full_line = std::string_view(shader).substr(i, endl - i);
-        std::string_view line = full_line;
-        auto trim = [&] {
-            while(!line.empty() && std::isspace(line.front())) {
-                line = line.substr(1);
-            }
-        };
-
-        trim();
-        if(!line.empty() && line.front() == '#') {
-            line = line.substr(1);
-            trim();
-            if(line.substr(0, 7) == "version") {
-                shader = shader.substr(0, endl) + add_defines() + shader.substr(endl);
-            } else if(line.substr(0, 7) == "include") {
-                line = line.substr(7);
-                trim();
-                if(!line.empty()) {
-                    const char delim = line.front();
-                    // TODO: parse <>
-                    const auto end = line.find(delim, 1);
-                    if(end != line.size() - 1 || delim != '"') {
-                        FATAL((std::string("Unable to parse shader include: \"") + std::string(full_line) + '"').c_str());
-                    }
+namespace OM3D {
 
-                    const std::string include_file(line.substr(1, end - 1));
-                    std::string include_content = add_defines();
-                    if(includes.find(include_file) == includes.end()) {
-                        includes.insert(include_file);
-                        auto content = read_text_file(std::string(shader_path) + include_file);
-                        if(!content.is_ok) {
-                            FATAL((std::string("Shader include not found: \"") + std::string(full_line) + '"').c_str());
-                        }
-                        include_content = std::move(content.value);
-                    }
+enum class AsyncCompilation {
+    None,
+    ParallelShaderCompile,
+    CompileThread,
+};
 
-                    shader = shader.substr(0, i) + include_content + shader.substr(endl);
-                    continue;
-                }
-            }
-        }
+static AsyncCompilation async_compilation = AsyncCompilation::None;
 
-        i = endl + 1;
-    }
+struct Program::PendingLink {
+    // Attached to the program, only used with ParallelShaderCompile
+    std::vector<GLuint> shaders;
 
-    return shader;
-}
+    // Only used with CompileThread, holds the error log (empty on success)
+    std::future<std::string> result;
+};
 
+// Does not check the compile status, so compilation can happen in parallel
 static GLuint create_shader(const std::string& src, GLenum type) {
     const GLuint handle = glCreateShader(type);
 
@@ -92,56 +47,258 @@ static GLuint create_shader(const std::string& src, GLenum type) {
     glShaderSource(handle, 1, &c_str, &len);
     glCompileShader(handle);
 
+    return handle;
+}
+
+static std::string shader_error(GLuint handle) {
     int res = 0;
     glGetShaderiv(handle, GL_COMPILE_STATUS, &res);
     if(!res) {
         int len = 0;
         char log[1024] = {};
         glGetShaderInfoLog(handle, sizeof(log), &len, log);
-        FATAL(log);
+        return log;
     }
-
-    return handle;
+    return {};
 }
 
-static void link_program(GLuint handle) {
-    glLinkProgram(handle);
-
+static std::string link_error(GLuint handle) {
     int res = 0;
     glGetProgramiv(handle, GL_LINK_STATUS, &res);
     if(!res) {
         int len = 0;
         char log[1024] = {};
         glGetProgramInfoLog(handle, sizeof(log), &len, log);
-        FATAL(log);
+        return log;
     }
+    return {};
 }
 
 
+// Compiles and links programs on a context shared with the main one
+class CompileThread : NonMovable {
+    struct Job {
+        GLuint program;
+        std::vector<std::pair<GLenum, std::string>> sources;
+        std::promise<std::string> result;
+    };
+
+    public:
+        CompileThread(GLFWwindow* context) : _context(context) {
+            _thread = std::thread([this] { run(); });
+        }
+
+        ~CompileThread() {
+            {
+                const std::unique_lock lock(_lock);
+                _stop = true;
+            }
+            _condition.notify_one();
+            _thread.join();
+        }
+
+        std::future<std::string> push(GLuint program, std::vector<std::pair<GLenum, std::string>> sources) {
+            Job job{program, std::move(sources), {}};
+            auto future = job.result.get_future();
+            {
+                const std::unique_lock lock(_lock);
+                _jobs.emplace_back(std::move(job));
+            }
+            _condition.notify_one();
+            return future;
+        }
+
+    private:
+        void run() {
+            glfwMakeContextCurrent(_context);
+            DEFER(glfwMakeContextCurrent(nullptr));
+
+            for(;;) {
+                Job job;
+                {
+                    std::unique_lock lock(_lock);
+                    _condition.wait(lock, [&] { return _stop || !_jobs.empty(); });
+                    if(_jobs.empty()) {
+                        return;
+                    }
+                    job = std::move(_jobs.front());
+                    _jobs.pop_front();
+                }
 
-Program::Program(const std::string& frag, const std::string& vert) : _handle(glCreateProgram()) {
-    const GLuint vert_handle = create_shader(vert, GL_VERTEX_SHADER);
-    const GLuint frag_handle = create_shader(frag, GL_FRAGMENT_SHADER);
+                std::string error;
+                std::vector<GLuint> shaders;
+                for(const auto& [type, src] : job.sources) {
+                    shaders.push_back(create_shader(src, type));
+                    glAttachShader(job.program, shaders.back());
+                }
 
-    glAttachShader(_handle.get(), vert_handle);
-    glAttachShader(_handle.get(), frag_handle);
+                glLinkProgram(job.program);
 
-    link_program(_handle.get());
+                for(const GLuint shader : shaders) {
+                    if(error.empty()) {
+                        error = shader_error(shader);
+                    }
+                    glDetachShader(job.program, shader);
+                    glDeleteShader(shader);
+                }
+                if(error.empty()) {
+                    error = link_error(job.program);
+                }
 
-    glDeleteShader(vert_handle);
-    glDeleteShader(frag_handle);
+                // Make sure the program is visible to the main context before signaling it
+                glFinish();
+                job.result.set_value(std::move(error));
+            }
+        }
 
-    fetch_uniform_locations();
+        GLFWwindow* _context = nullptr;
+        std::thread _thread;
+
+        std::mutex _lock;
+        std::condition_variable _condition;
+        std::deque<Job> _jobs;
+        bool _stop = false;
+};
+
+static std::unique_ptr<CompileThread> compile_thread;
+static GLFWwindow* compile_thread_context = nullptr;
+
+void Program::init_async_compilation(GLFWwindow* window) {
+    using max_threads_func = void (APIENTRYP)(GLuint);
+
+    for(const char* ext : {"GL_KHR_parallel_shader_compile", "GL_ARB_parallel_shader_compile"}) {
+        if(!glfwExtensionSupported(ext)) {
+            continue;
+        }
+        const bool is_khr = ext[3] == 'K';
+        if(auto max_threads = reinterpret_cast<max_threads_func>(glfwGetProcAddress(is_khr ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB"))) {
+            // Let the driver pick the number of threads
+            max_threads(0xFFFFFFFF);
+            async_compilation = AsyncCompilation::ParallelShaderCompile;
+            std::cout << "Shaders are compiled using " << ext << std::endl;
+            return;
+        }
+    }
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    compile_thread_context = glfwCreateWindow(1, 1, "Shader compiler", nullptr, window);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if(!compile_thread_context) {
+        std::cerr << "Unable to create shared context, shaders will be compiled synchronously" << std::endl;
+        return;
+    }
+
+    compile_thread = std::make_unique<CompileThread>(compile_thread_context);
+    async_compilation = AsyncCompilation::CompileThread;
+    std::cout << "Shaders are compiled on a background thread" << std::endl;
 }
 
-Program::Program(const std::string& comp) : _handle(glCreateProgram()), _is_compute(true) {
-    const GLuint comp_handle = create_shader(comp, GL_COMPUTE_SHADER);
+void Program::shutdown_async_compilation() {
+    compile_thread = nullptr;
+    if(compile_thread_context) {
+        glfwDestroyWindow(compile_thread_context);
+        compile_thread_context = nullptr;
+    }
+    async_compilation = AsyncCompilation::None;
+}
 
-    glAttachShader(_handle.get(), comp_handle);
 
-    link_program(_handle.get());
 
-    glDeleteShader(comp_handle);
+Program::Program(const std::string& frag, const std::string& vert) : Program({{GL_VERTEX_SHADER, vert}, {GL_FRAGMENT_SHADER, frag}}, false) {
+    wait();
+}
+
+Program::Program(const std::string& comp) : Program({{GL_COMPUTE_SHADER, comp}}, true) {
+    wait();
+}
+
+Program::Program(std::vector<ShaderSource> sources, bool is_compute) : _handle(glCreateProgram()), _is_compute(is_compute) {
+    _pending = std::make_shared<PendingLink>();
+
+    if(async_compilation == AsyncCompilation::CompileThread) {
+        std::vector<std::pair<GLenum, std::string>> thread_sources;
+        for(ShaderSource& src : sources) {
+            thread_sources.emplace_back(GLenum(src.type), std::move(src.source));
+        }
+        _pending->result = compile_thread->push(_handle.get(), std::move(thread_sources));
+        return;
+    }
+
+    for(const ShaderSource& src : sources) {
+        _pending->shaders.push_back(create_shader(src.source, src.type));
+        glAttachShader(_handle.get(), _pending->shaders.back());
+    }
+
+    glLinkProgram(_handle.get());
+}
+
+bool Program::is_ready() {
+    if(!_pending) {
+        return true;
+    }
+
+    switch(async_compilation) {
+        case AsyncCompilation::ParallelShaderCompile: {
+            int done = 0;
+            glGetProgramiv(_handle.get(), GL_COMPLETION_STATUS_KHR, &done);
+            if(!done) {
+                return false;
+            }
+        } break;
+
+        case AsyncCompilation::CompileThread:
+            if(_pending->result.valid() && _pending->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return false;
+            }
+        break;
+
+        case AsyncCompilation::None:
+        break;
+    }
+
+    finish_link();
+    return true;
+}
+
+void Program::wait() {
+    if(!_pending) {
+        return;
+    }
+
+    if(_pending->result.valid()) {
+        _pending->result.wait();
+    }
+
+    // Status queries block until the driver is done
+    finish_link();
+}
+
+void Program::finish_link() {
+    DEBUG_ASSERT(_pending);
+
+    std::string error;
+    if(_pending->result.valid()) {
+        error = _pending->result.get();
+    }
+
+    for(const GLuint shader : _pending->shaders) {
+        if(error.empty()) {
+            error = shader_error(shader);
+        }
+        glDetachShader(_handle.get(), shader);
+        glDeleteShader(shader);
+    }
+
+    if(error.empty()) {
+        error = link_error(_handle.get());
+    }
+
+    _pending = nullptr;
+
+    if(!error.empty()) {
+        FATAL(error.c_str());
+    }
 
     fetch_uniform_locations();
 }
@@ -167,6 +324,10 @@ void Program::fetch_uniform_locations() {
 }
 
 Program::~Program() {
+    if(_pending && _pending->result.valid()) {
+        // The compile thread might still be using the handle
+        _pending->result.wait();
+    }
     if(_handle.is_valid()) {
         glDeleteProgram(_handle.get());
     }
@@ -180,35 +341,162 @@ bool Program::is_compute() const {
     return _is_compute;
 }
 
-std::shared_ptr<Program> Program::from_file(const std::string& comp, Span<const std::string> defines) {
-    static std::unordered_map<std::vector<std::string>, std::weak_ptr<Program>, CollectionHasher<std::vector<std::string>>> loaded;
+u64 Program::source_hash() const {
+    return _source_hash;
+}
 
-    std::vector<std::string> key(defines.begin(), defines.end());
-    key.emplace_back(comp);
+// Programs are cached on their files and defines, so cache hits skip the preprocessor, and on the hash of their
+// preprocessed sources (which include the defines), so identical permutations are shared.
+// Entries only keep what identifies them, and are dropped once their program is released.
+struct ProgramRequest {
+    bool is_compute;
+    // Compute shader of compute programs
+    std::string frag;
+    std::string vert;
+    std::vector<std::string> defines;
+};
+
+struct ProgramSources {
+    bool is_compute;
+    // Tells hash collisions apart
+    u64 check;
+    size_t length;
+};
+
+template<typename K>
+struct CachedProgram {
+    K key;
+    std::weak_ptr<Program> program;
+};
+
+template<typename K>
+using ProgramCache = std::unordered_map<u64, std::vector<CachedProgram<K>>>;
+
+static ProgramCache<ProgramRequest> requested_programs;
+static ProgramCache<ProgramSources> loaded_programs;
+
+template<typename K, typename M, typename C>
+static std::weak_ptr<Program>& find_or_insert(ProgramCache<K>& cache, u64 hash, M&& matches, C&& create_key) {
+    const auto is_released = [](const CachedProgram<K>& cached) { return cached.program.expired(); };
+
+    std::vector<CachedProgram<K>>& entries = cache[hash];
+    entries.erase(std::remove_if(entries.begin(), entries.end(), is_released), entries.end());
+    for(CachedProgram<K>& cached : entries) {
+        if(matches(cached.key)) {
+            return cached.program;
+        }
+    }
 
-    auto& weak_program = loaded[key];
+    // Misses compile a program, so they can afford to drop every released one
+    for(auto it = cache.begin(); it != cache.end();) {
+        std::vector<CachedProgram<K>>& other = it->second;
+        other.erase(std::remove_if(other.begin(), other.end(), is_released), other.end());
+        if(other.empty() && &other != &entries) {
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return entries.emplace_back(CachedProgram<K>{create_key(), {}}).program;
+}
+
+// Returns the program of the request if it is still alive, calls create otherwise
+template<typename F>
+static std::shared_ptr<Program> requested_program(bool is_compute, const std::string& frag, const std::string& vert, Span<const std::string> defines, F&& create) {
+    u64 hash = str_hash_64(frag);
+    hash_combine(hash, str_hash_64(vert));
+    for(const std::string& define : defines) {
+        hash_combine(hash, str_hash_64(define));
+    }
+    hash_combine(hash, u64(is_compute));
+
+    const auto matches = [&](const ProgramRequest& request) {
+        return request.is_compute == is_compute && request.frag == frag && request.vert == vert &&
+               std::equal(request.defines.begin(), request.defines.end(), defines.begin(), defines.end());
+    };
+    const auto create_key = [&] {
+        return ProgramRequest{is_compute, frag, vert, std::vector<std::string>(defines.begin(), defines.end())};
+    };
+
+    std::weak_ptr<Program>& weak_program = find_or_insert(requested_programs, hash, matches, create_key);
     auto program = weak_program.lock();
     if(!program) {
-        program = std::make_shared<Program>(read_shader(comp, defines));
+        program = create();
         weak_program = program;
     }
     return program;
 }
 
+static std::weak_ptr<Program>& loaded_program(u64 hash, bool is_compute, Span<const std::string_view> sources) {
+    u64 check = 0;
+    size_t length = 0;
+    for(const std::string_view source : sources) {
+        hash_combine(check, u64(std::hash<std::string_view>{}(source)));
+        length += source.size();
+    }
+
+    const auto matches = [&](const ProgramSources& cached) {
+        return cached.is_compute == is_compute && cached.check == check && cached.length == length;
+    };
+    return find_or_insert(loaded_programs, hash, matches, [&] { return ProgramSources{is_compute, check, length}; });
+}
+
+std::shared_ptr<Program> Program::from_file(const std::string& comp, Span<const std::string> defines) {
+    auto program = from_file_async(comp, defines);
+    program->wait();
+    return program;
+}
+
+std::shared_ptr<Program> Program::from_file_async(const std::string& comp, Span<const std::string> defines) {
+    return requested_program(true, comp, std::string(), defines, [&] {
+        const PreprocessedShader shader = preprocess_shader(comp, defines);
+
+        const std::string_view sources[] = {shader.source};
+        auto& weak_program = loaded_program(shader.hash, true, sources);
+        auto program = weak_program.lock();
+        if(!program) {
+            program = std::shared_ptr<Program>(new Program({{GL_COMPUTE_SHADER, shader.source}}, true));
+            program->_source_hash = shader.hash;
+            weak_program = program;
+        }
+        return program;
+    });
+}
+
 std::shared_ptr<Program> Program::from_files(const std::string& frag, const std::string& vert, Span<const std::string> defines) {
-    static std::unordered_map<std::vector<std::string>, std::weak_ptr<Program>, CollectionHasher<std::vector<std::string>>> loaded;
+    auto program = from_files_async(frag, vert, defines);
+    program->wait();
+    return program;
+}
 
-    std::vector<std::string> key(defines.begin(), defines.end());
-    key.emplace_back(frag);
-    key.emplace_back(vert);
+std::shared_ptr<Program> Program::from_files_async(const std::string& frag, const std::string& vert, Span<const std::string> defines) {
+    return requested_program(false, frag, vert, defines, [&] {
+        const PreprocessedShader vert_shader = preprocess_shader(vert, defines);
+        const PreprocessedShader frag_shader = preprocess_shader(frag, defines);
+
+        u64 hash = vert_shader.hash;
+        hash_combine(hash, frag_shader.hash);
+
+        const std::string_view sources[] = {vert_shader.source, frag_shader.source};
+        auto& weak_program = loaded_program(hash, false, sources);
+        auto program = weak_program.lock();
+        if(!program) {
+            program = std::shared_ptr<Program>(new Program({{GL_VERTEX_SHADER, vert_shader.source}, {GL_FRAGMENT_SHADER, frag_shader.source}}, false));
+            program->_source_hash = hash;
+            weak_program = program;
+        }
+        return program;
+    });
+}
 
-    auto& weak_program = loaded[key];
-    auto program = weak_program.lock();
-    if(!program) {
-        program = std::make_shared<Program>(read_shader(frag, defines), read_shader(vert, defines));
-        weak_program = program;
+std::vector<std::shared_ptr<Program>> Program::precompile(Span<const ProgramDesc> programs) {
+    // Start every compilation before waiting on any, so they can overlap
+    std::vector<std::shared_ptr<Program>> compiled;
+    for(const ProgramDesc& desc : programs) {
+        compiled.emplace_back(desc.comp.empty() ? from_files_async(desc.frag, desc.vert, desc.defines) : from_file_async(desc.comp, desc.defines));
     }
-    return program;
+    return compiled;
 }
 
 int Program::find_location(u32 hash) {
@@ -236,6 +524,12 @@ void Program::set_uniform(u32 name_hash, glm::vec2 value) {
     }
 }
 
+void Program::set_uniform(u32 name_hash, glm::uvec2 value) {
+    if(const int loc = find_location(name_hash); loc >= 0) {
+        glProgramUniform2ui(_handle.get(), loc, value.x, value.y);
+    }
+}
+
 void Program::set_uniform(u32 name_hash, glm::vec3 value) {
     if(const int loc = find_location(name_hash); loc >= 0) {
         glProgramUniform3f(_handle.get(), loc, value.x, value.y, value.z);
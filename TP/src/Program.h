@@ -13,10 +13,28 @@
 #include <memory>
 #include <vector>
 
+struct GLFWwindow;
+
 namespace OM3D {
 
+struct ProgramDesc {
+    std::string frag;
+    std::string vert;
+    std::vector<std::string> defines;
+
+    // Compute program when set, frag and vert are ignored
+    std::string comp = {};
+};
+
 class Program : NonCopyable {
 
+    struct ShaderSource {
+        u32 type;
+        std::string source;
+    };
+
+    struct PendingLink;
+
     struct UniformLocationInfo {
         u32 name_hash;
         int location;
@@ -42,12 +60,31 @@ class Program : NonCopyable {
 
         bool is_compute() const;
 
+        // Never blocks: returns false while the program is still compiling in the background
+        bool is_ready();
+        void wait();
+
+        // Hash of the preprocessed sources, 0 for programs not created from files
+        u64 source_hash() const;
+
         static std::shared_ptr<Program> from_file(const std::string& comp, Span<const std::string> defines = {});
         static std::shared_ptr<Program> from_files(const std::string& frag, const std::string& vert, Span<const std::string> defines = {});
 
+        // Return immediately, use is_ready() before binding the program
+        static std::shared_ptr<Program> from_file_async(const std::string& comp, Span<const std::string> defines = {});
+        static std::shared_ptr<Program> from_files_async(const std::string& frag, const std::string& vert, Span<const std::string> defines = {});
+
+        // Starts compiling all the programs at once, keep the result alive for the programs to stay cached
+        static std::vector<std::shared_ptr<Program>> precompile(Span<const ProgramDesc> programs);
+
+        // Uses GL_KHR_parallel_shader_compile if supported, a compile thread with a context shared with window otherwise
+        static void init_async_compilation(GLFWwindow* window);
+        static void shutdown_async_compilation();
+
         void set_uniform(u32 name_hash, u32 value);
         void set_uniform(u32 name_hash, float value);
         void set_uniform(u32 name_hash, glm::vec2 value);
+        void set_uniform(u32 name_hash, glm::uvec2 value);
         void set_uniform(u32 name_hash, glm::vec3 value);
         void set_uniform(u32 name_hash, glm::vec4 value);
         void set_uniform(u32 name_hash, const glm::mat2& value);
@@ -60,12 +97,17 @@ class Program : NonCopyable {
         }
 
     private:
+        Program(std::vector<ShaderSource> sources, bool is_compute);
+
+        void finish_link();
         void fetch_uniform_locations();
         int find_location(u32 hash);
 
         GLHandle _handle;
         std::vector<UniformLocationInfo> _uniform_locations;
+        std::shared_ptr<PendingLink> _pending;
 
+        u64 _source_hash = 0;
         bool _is_compute = false;
 
 };
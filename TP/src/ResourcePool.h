@@ -0,0 +1,137 @@
+#ifndef RESOURCEPOOL_H
+#define RESOURCEPOOL_H
+
+#include <utils.h>
+
+#include <memory>
+#include <vector>
+
+namespace OM3D {
+
+template<typename T>
+class ResourcePool;
+
+// 32 bits handle: slot index + generation of the slot, so handles to removed resources are detected
+template<typename T>
+class Handle {
+    public:
+        static constexpr u32 index_bits = 20;
+        static constexpr u32 generation_bits = 32 - index_bits;
+        static constexpr u32 max_index = (1u << index_bits) - 2; // All ones is the invalid handle
+
+        Handle() = default;
+
+        u32 index() const {
+            return _value & ((1u << index_bits) - 1);
+        }
+
+        u32 generation() const {
+            return _value >> index_bits;
+        }
+
+        u32 value() const {
+            return _value;
+        }
+
+        bool is_valid() const {
+            return _value != invalid;
+        }
+
+        bool operator==(const Handle& other) const {
+            return _value == other._value;
+        }
+
+        bool operator!=(const Handle& other) const {
+            return _value != other._value;
+        }
+
+    private:
+        friend class ResourcePool<T>;
+
+        static constexpr u32 invalid = u32(-1);
+
+        Handle(u32 index, u32 generation) : _value(index | (generation << index_bits)) {
+        }
+
+        u32 _value = invalid;
+};
+
+class StaticMesh;
+class Material;
+
+using MeshHandle = Handle<StaticMesh>;
+using MaterialHandle = Handle<Material>;
+
+// Owns resources and hands out handles to them. Looking up a handle is an index and a generation check,
+// without the reference count traffic of copying shared_ptrs.
+// Removing a resource drops the pool reference, shared_ptrs obtained with get_shared keep it alive.
+template<typename T>
+class ResourcePool : NonMovable {
+    public:
+        Handle<T> add(std::shared_ptr<T> resource) {
+            DEBUG_ASSERT(resource);
+
+            u32 index = 0;
+            if(_free.empty()) {
+                index = u32(_slots.size());
+                ALWAYS_ASSERT(index <= Handle<T>::max_index, "Resource pool is full");
+                _slots.emplace_back();
+            } else {
+                index = _free.back();
+                _free.pop_back();
+            }
+
+            Slot& slot = _slots[index];
+            slot.resource = std::move(resource);
+            ++_size;
+            return Handle<T>(index, slot.generation);
+        }
+
+        void remove(Handle<T> handle) {
+            if(!contains(handle)) {
+                return;
+            }
+
+            Slot& slot = _slots[handle.index()];
+            slot.resource = nullptr;
+            slot.generation = (slot.generation + 1) & ((1u << Handle<T>::generation_bits) - 1);
+            _free.push_back(handle.index());
+            --_size;
+        }
+
+        bool contains(Handle<T> handle) const {
+            return handle.is_valid() && handle.index() < _slots.size() && _slots[handle.index()].generation == handle.generation() && _slots[handle.index()].resource;
+        }
+
+        // nullptr if the handle is invalid or the resource was removed
+        T* get(Handle<T> handle) const {
+            return contains(handle) ? _slots[handle.index()].resource.get() : nullptr;
+        }
+
+        std::shared_ptr<T> get_shared(Handle<T> handle) const {
+            return contains(handle) ? _slots[handle.index()].resource : nullptr;
+        }
+
+        size_t size() const {
+            return _size;
+        }
+
+        static ResourcePool& global() {
+            static ResourcePool pool;
+            return pool;
+        }
+
+    private:
+        struct Slot {
+            std::shared_ptr<T> resource;
+            u32 generation = 0;
+        };
+
+        std::vector<Slot> _slots;
+        std::vector<u32> _free;
+        size_t _size = 0;
+};
+
+}
+
+#endif // RESOURCEPOOL_H
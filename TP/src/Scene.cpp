@@ -4,32 +4,195 @@
 
 #include <TypedBuffer.h>
 #include <ObjectBatcher.h>
+#include <AllocationTracker.h>
+#include <CommandBuffer.h>
+#include <ThreadPool.h>
 
 #include <shader_structs.h>
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <cmath>
+#include <optional>
 
 namespace OM3D {
 
+// Below this, splitting the recording costs more than it saves
+static constexpr size_t min_objects_per_recording_task = 2048;
+
+SceneObjectView::SceneObjectView(const Scene* scene, u32 index) : _scene(scene), _index(index) {
+}
+
+const glm::mat4& SceneObjectView::transform() const {
+    return _scene->_object_transforms[_index];
+}
+
+const BoundingSphere& SceneObjectView::world_bounding_sphere() const {
+    return _scene->_object_bounds[_index];
+}
+
+bool SceneObjectView::is_occluder() const {
+    return _scene->_object_flags[_index] & Scene::Occluder;
+}
+
+MeshHandle SceneObjectView::mesh_handle() const {
+    return _scene->_object_meshes[_index];
+}
+
+MaterialHandle SceneObjectView::material_handle() const {
+    return _scene->_object_materials[_index];
+}
+
+StaticMesh* SceneObjectView::get_mesh() const {
+    return ResourcePool<StaticMesh>::global().get(mesh_handle());
+}
+
+Material* SceneObjectView::get_material() const {
+    return ResourcePool<Material>::global().get(material_handle());
+}
+
 Scene::Scene() {
 }
 
-void Scene::add_object(SceneObject obj) {
-    _objects.emplace_back(std::move(obj));
+Scene::~Scene() {
+    for(const MeshHandle mesh : _meshes) {
+        ResourcePool<StaticMesh>::global().remove(mesh);
+    }
+    for(const MaterialHandle material : _materials) {
+        ResourcePool<Material>::global().remove(material);
+    }
+}
+
+MeshHandle Scene::add_mesh(std::shared_ptr<StaticMesh> mesh) {
+    return _meshes.emplace_back(ResourcePool<StaticMesh>::global().add(std::move(mesh)));
+}
+
+MaterialHandle Scene::add_material(std::shared_ptr<Material> material) {
+    return _materials.emplace_back(ResourcePool<Material>::global().add(std::move(material)));
+}
+
+ObjectId Scene::add_object(const SceneObject& obj) {
+    ObjectId id = ObjectId(_object_indices.size());
+    if(!_free_object_ids.empty()) {
+        id = _free_object_ids.back();
+        _free_object_ids.pop_back();
+    } else {
+        _object_indices.push_back(invalid_index);
+    }
+
+    const StaticMesh* mesh = obj.get_mesh();
+
+    _object_indices[id] = u32(_object_ids.size());
+    _object_ids.push_back(id);
+    _object_bounds.emplace_back();
+    _object_transforms.push_back(obj.transform());
+    _object_meshes.push_back(obj.mesh_handle());
+    _object_materials.push_back(obj.material_handle());
+    _object_flags.push_back(obj.is_occluder() ? Occluder : 0);
+    _object_lod_counts.push_back(u8(mesh ? mesh->lod_count() : 1));
+    _object_lods.push_back(0);
+
+    update_object_bounds(_object_indices[id]);
+    return id;
+}
+
+ObjectId Scene::add_object(const SceneObject& obj, TransformHierarchy::NodeId node) {
+    const ObjectId id = add_object(obj);
+    if(!_node_objects.empty() && _node_objects.back().first > node) {
+        _node_objects_sorted = false;
+    }
+    _node_objects.emplace_back(node, id);
+    return id;
 }
 
 void Scene::add_object(PointLight obj) {
     _point_lights.emplace_back(std::move(obj));
 }
 
-const SceneObject& Scene::get_object(int index) const {
-    return _objects[index];
+void Scene::remove_object(ObjectId id) {
+    ALWAYS_ASSERT(contains_object(id), "Invalid object id");
+
+    const u32 index = _object_indices[id];
+    const u32 last = u32(_object_ids.size() - 1);
+
+    const auto swap_remove = [=](auto& vec) {
+        vec[index] = vec[last];
+        vec.pop_back();
+    };
+
+    _object_indices[_object_ids[last]] = index;
+    swap_remove(_object_ids);
+    swap_remove(_object_bounds);
+    swap_remove(_object_transforms);
+    swap_remove(_object_meshes);
+    swap_remove(_object_materials);
+    swap_remove(_object_flags);
+    swap_remove(_object_lod_counts);
+    swap_remove(_object_lods);
+
+    _object_indices[id] = invalid_index;
+    _free_object_ids.push_back(id);
+
+    // Removing keeps the node order
+    _node_objects.erase(std::remove_if(_node_objects.begin(), _node_objects.end(), [=](const auto& p) { return p.second == id; }), _node_objects.end());
+}
+
+bool Scene::contains_object(ObjectId id) const {
+    return id < _object_indices.size() && _object_indices[id] != invalid_index;
+}
+
+size_t Scene::object_count() const {
+    return _object_ids.size();
+}
+
+SceneObjectView Scene::get_object(ObjectId id) const {
+    DEBUG_ASSERT(contains_object(id));
+    return SceneObjectView(this, _object_indices[id]);
+}
+
+void Scene::set_object_transform(ObjectId id, const glm::mat4& transform) {
+    DEBUG_ASSERT(contains_object(id));
+    const u32 index = _object_indices[id];
+    _object_transforms[index] = transform;
+    update_object_bounds(index);
 }
 
 void Scene::set_point_light_volume(std::shared_ptr<StaticMesh> volume) {
     _point_light_volume = volume;
 }
 
+TransformHierarchy& Scene::transform_hierarchy() {
+    return _transform_hierarchy;
+}
+
+const TransformHierarchy& Scene::transform_hierarchy() const {
+    return _transform_hierarchy;
+}
+
+void Scene::update_transforms() {
+    const Span<const TransformHierarchy::NodeId> changed = _transform_hierarchy.update();
+    if(changed.is_empty()) {
+        return;
+    }
+
+    if(!_node_objects_sorted) {
+        std::sort(_node_objects.begin(), _node_objects.end());
+        _node_objects_sorted = true;
+    }
+
+    // Both are sorted by node
+    auto it = _node_objects.begin();
+    for(const TransformHierarchy::NodeId node : changed) {
+        while(it != _node_objects.end() && it->first < node) {
+            ++it;
+        }
+        for(; it != _node_objects.end() && it->first == node; ++it) {
+            set_object_transform(it->second, _transform_hierarchy.world_matrix(node));
+        }
+    }
+}
+
 static bool isInBound(const glm::vec3& object_dir, const glm::vec3& normal, float radius) {
     float distance = glm::dot(object_dir, normal);
     return distance > -radius;
@@ -66,110 +229,255 @@ static bool cullObject(const BoundingSphere& bounding_sphere, const glm::vec3& c
     return false;
 }
 
-void Scene::render(const Camera& camera) const {
-    // Fill and bind frame data buffer
-    TypedBuffer<shader::FrameData> buffer(nullptr, 1);
-    {
-        auto mapping = buffer.map(AccessType::WriteOnly);
-        mapping[0].camera.view_proj = camera.view_proj_matrix();
-        mapping[0].point_light_count = u32(_point_lights.size());
-        mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
-        mapping[0].sun_dir = glm::normalize(_sun_direction);
+static BoundingSphere transform_bounding_sphere(const BoundingSphere& sphere, const glm::mat4& model) {
+    BoundingSphere transformed;
+    transformed.center = model * glm::vec4(sphere.center, 1.0f);
+
+    // Scale by the largest basis vector, so the sphere stays conservative under non uniform scale
+    const float scale_x = glm::length(glm::vec3(model[0]));
+    const float scale_y = glm::length(glm::vec3(model[1]));
+    const float scale_z = glm::length(glm::vec3(model[2]));
+    transformed.radius = sphere.radius * std::max(scale_x, std::max(scale_y, scale_z));
+
+    return transformed;
+}
+
+static float projected_pixel_radius(const BoundingSphere& bounding_sphere, const Camera& camera, float viewport_height) {
+    const float distance = glm::length(bounding_sphere.center - camera.position());
+    if(distance <= bounding_sphere.radius) {
+        return std::numeric_limits<float>::max();
     }
-    buffer.bind(BufferUsage::Uniform, 0);
 
-    // Fill and bind lights buffer
-    TypedBuffer<shader::PointLight> light_buffer(nullptr, std::max(_point_lights.size(), size_t(1)));
-    {
-        auto mapping = light_buffer.map(AccessType::WriteOnly);
-        for(size_t i = 0; i != _point_lights.size(); ++i) {
-            const auto& light = _point_lights[i];
-            mapping[i] = {
-                light.position(),
-                light.radius(),
-                light.color(),
-                0.0f
-            };
-        }
+    // proj[1][1] is the cotangent of half the vertical fov
+    return bounding_sphere.radius / distance * camera.projection_matrix()[1][1] * viewport_height * 0.5f;
+}
+
+static u32 select_lod(float pixel_radius, u32 previous_lod, u32 lod_count, const CullingSettings& culling) {
+    if(lod_count <= 1 || pixel_radius >= culling.lod_pixel_radius) {
+        return 0;
     }
-    light_buffer.bind(BufferUsage::Storage, 1);
 
-    // Render every object
-    glm::vec3 camera_position = camera.position();
-    Frustum frustum = camera.build_frustum();
-    ObjectBatcher batcher;
-    // Render every object
-    for(const SceneObject& obj : _objects) {
-        auto model = obj.transform();
-
-        BoundingSphere transformedBoundingSphere = obj.boundingSphere();
-        transformedBoundingSphere.center = model * glm::vec4(transformedBoundingSphere.center, 1.0f);
-
-        glm::vec3 scale;
-        scale.x = glm::length(glm::vec3(model[0])); // Basis vector X
-        scale.y = glm::length(glm::vec3(model[1])); // Basis vector Y
-        scale.z = glm::length(glm::vec3(model[2])); // Basis vector Z
-        float scale_factor = scale.x;
-        if (scale.y > scale_factor)
-            scale_factor *= scale.y;
-        if (scale.z > scale_factor)
-            scale_factor *= scale.z;
-        transformedBoundingSphere.radius *= scale_factor;
-
-        if (cullObject(transformedBoundingSphere, camera_position, frustum))
-            continue;
+    // Continuous LOD: 0 at lod_pixel_radius, +1 every time the radius halves
+    const float lod = std::log2(culling.lod_pixel_radius / pixel_radius);
+    const u32 max_lod = lod_count - 1;
 
-        batcher.add_object(obj);
+    previous_lod = std::min(previous_lod, max_lod);
+    if(lod >= float(previous_lod) - culling.lod_hysteresis && lod < float(previous_lod + 1) + culling.lod_hysteresis) {
+        return previous_lod;
     }
+    return std::min(u32(lod), max_lod);
+}
 
-    batcher.render();
+void Scene::update_object_bounds(u32 index) {
+    const StaticMesh* mesh = ResourcePool<StaticMesh>::global().get(_object_meshes[index]);
+    const BoundingSphere local = mesh ? mesh->boundingSphere() : BoundingSphere{glm::vec3(0.0f), 0.0f};
+    _object_bounds[index] = transform_bounding_sphere(local, _object_transforms[index]);
 }
 
-void Scene::deferred_lighting(const Camera& camera, const Material& sun_material,
-                              Material& point_light_material) const {
+void Scene::bind_frame_data(const Camera& camera, const Viewport& viewport, u32 point_light_count) const {
     // Fill and bind frame data buffer
     TypedBuffer<shader::FrameData> buffer(nullptr, 1);
     {
         auto mapping = buffer.map(AccessType::WriteOnly);
         mapping[0].camera.view_proj = camera.view_proj_matrix();
-        mapping[0].point_light_count = u32(_point_lights.size());
+        mapping[0].camera.inv_view_proj = glm::inverse(camera.view_proj_matrix());
+        mapping[0].point_light_count = point_light_count;
         mapping[0].sun_color = glm::vec3(1.0f, 1.0f, 1.0f);
         mapping[0].sun_dir = glm::normalize(_sun_direction);
+        mapping[0].viewport_size = glm::vec2(viewport.size);
+        mapping[0].viewport_uv_scale = viewport.uv_scale();
     }
     buffer.bind(BufferUsage::Uniform, 0);
+}
+
+void Scene::cull_objects(const Camera& camera, const Viewport& viewport, const CullingSettings& culling, FrameVector<u32>& visible) const {
+    const glm::vec3 camera_position = camera.position();
+    const Frustum frustum = camera.build_frustum();
+    const float viewport_height = float(viewport.size.y);
+
+    visible.clear();
+    visible.reserve(_object_bounds.size());
+    for(u32 i = 0; i != u32(_object_bounds.size()); ++i) {
+        const BoundingSphere& bounding_sphere = _object_bounds[i];
+        if (cullObject(bounding_sphere, camera_position, frustum))
+            continue;
+
+        const float pixel_radius = projected_pixel_radius(bounding_sphere, camera, viewport_height);
+        if(pixel_radius < culling.min_pixel_radius)
+            continue;
+
+        _object_lods[i] = u8(select_lod(pixel_radius, _object_lods[i], _object_lod_counts[i], culling));
+
+        visible.push_back(i);
+    }
+}
+
+void Scene::render(const Camera& camera, const Viewport& viewport, const CullingSettings& culling, DepthPrepass* depth_prepass) const {
+    ALLOCATION_SCOPE("Scene::render");
+
+    bind_frame_data(camera, viewport, 0);
+
+    FrameVector<u32> visible;
+    cull_objects(camera, viewport, culling, visible);
+
+    // Closest view depth of the object, for front to back sorting
+    const glm::vec3 camera_position = camera.position();
+    const glm::vec3 camera_forward = camera.forward();
+    const auto add_to_batch = [&](ObjectBatcher& batcher, u32 i) {
+        const BoundingSphere& bounding_sphere = _object_bounds[i];
+        const float depth = glm::dot(bounding_sphere.center - camera_position, camera_forward) - bounding_sphere.radius;
+        batcher.add_object(_object_materials[i], _object_meshes[i], _object_transforms[i], _object_lods[i], depth);
+    };
+
+    OcclusionRasterizer* software = culling.software_occlusion;
+    if(software) {
+        software->begin(camera.view_proj_matrix());
+        for(const u32 i : visible) {
+            if(_object_flags[i] & Occluder) {
+                software->add_occluder(*ResourcePool<StaticMesh>::global().get(_object_meshes[i])->occluder_mesh(), _object_transforms[i]);
+            }
+        }
+        software->rasterize();
+    }
+
+    HiZBuffer* occlusion = culling.hiz;
+    if(occlusion) {
+        occlusion->fetch();
+    }
+
+    // Occlusion tests and draw recording are split across threads for big scenes.
+    // Every task batches and records its own objects, the GL thread only submits.
+    struct RecordingTask {
+        CommandBuffer depth_commands;
+        CommandBuffer commands;
+        CommandBuffer transparent_commands;
+        // Objects that were hidden in the previous frame depth buffer
+        FrameVector<u32> occluded;
+    };
+
+    const bool prepass = depth_prepass && depth_prepass->is_enabled();
+
+    ThreadPool& pool = ThreadPool::global();
+    const size_t task_count = std::clamp(visible.size() / min_objects_per_recording_task, size_t(1), size_t(pool.thread_count()) + 1);
+    FrameVector<std::optional<RecordingTask>> tasks(task_count);
+
+    pool.parallel_for(task_count, [&](size_t t) {
+        // Created by the recording thread, to use its frame allocator
+        RecordingTask& task = tasks[t].emplace();
+
+        ObjectBatcher batcher;
+        const size_t end = visible.size() * (t + 1) / task_count;
+        for(size_t k = visible.size() * t / task_count; k != end; ++k) {
+            const u32 i = visible[k];
+            const BoundingSphere& bounding_sphere = _object_bounds[i];
+            if (software && !(_object_flags[i] & Occluder) && software->is_occluded(bounding_sphere))
+                continue;
+
+            if (occlusion && occlusion->is_occluded(bounding_sphere)) {
+                task.occluded.push_back(i);
+                continue;
+            }
+
+            add_to_batch(batcher, i);
+        }
+        if(prepass) {
+            batcher.record_depth(task.depth_commands, depth_prepass->material());
+        }
+        batcher.record(task.commands, task.transparent_commands, prepass ? DrawMode::DepthEqual : DrawMode::Standard);
+    });
 
-    // Fill and bind lights buffer
-    TypedBuffer<shader::PointLight> light_buffer(nullptr, std::max(_point_lights.size(), size_t(1)));
     {
-        auto mapping = light_buffer.map(AccessType::WriteOnly);
-        for(size_t i = 0; i != _point_lights.size(); ++i) {
-            const auto& light = _point_lights[i];
-            mapping[i] = {
-                light.position(),
-                light.radius(),
-                light.color(),
-                0.0f
-            };
+        FrameVector<const CommandBuffer*> depth_buffers;
+        FrameVector<const CommandBuffer*> buffers;
+        FrameVector<const CommandBuffer*> transparent_buffers;
+        for(const auto& task : tasks) {
+            depth_buffers.push_back(&task->depth_commands);
+            buffers.push_back(&task->commands);
+            transparent_buffers.push_back(&task->transparent_commands);
         }
+
+        // Overdraw is measured on the first pass to test the opaque draws against the scene depth.
+        // The prepass draws them in the G-buffer order, so both modes measure the same fragments.
+        if(depth_prepass) {
+            depth_prepass->begin_measure();
+        }
+        if(prepass) {
+            submit_commands(depth_buffers);
+            depth_prepass->end_measure(viewport.size);
+        }
+
+        submit_commands(buffers);
+        if(depth_prepass && !prepass) {
+            depth_prepass->end_measure(viewport.size);
+        }
+
+        submit_commands(transparent_buffers);
     }
-    light_buffer.bind(BufferUsage::Storage, 1);
 
-    sun_material.bind();
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    if(occlusion) {
+        occlusion->update(camera.view_proj_matrix(), viewport.uv_scale(), occlusion->is_two_phase());
+
+        if(occlusion->is_two_phase()) {
+            // Second phase: test again against this frame depth to draw disoccluded objects
+            ObjectBatcher disoccluded;
+            for(const auto& task : tasks) {
+                for(const u32 i : task->occluded) {
+                    if(!occlusion->is_occluded(_object_bounds[i])) {
+                        add_to_batch(disoccluded, i);
+                    }
+                }
+            }
+            disoccluded.render();
+        }
+    }
+}
+
+void Scene::deferred_lighting(const Camera& camera, const Viewport& viewport, const Material& sun_material,
+                              Material& point_light_material, Material& light_stencil_material) const {
+    ALLOCATION_SCOPE("Scene::deferred_lighting");
+
+    // Only upload lights that touch the frustum
+    const glm::vec3 camera_position = camera.position();
+    const Frustum frustum = camera.build_frustum();
+
+    FrameVector<shader::PointLight> visible_lights;
+    visible_lights.reserve(_point_lights.size());
+    for(const PointLight& light : _point_lights) {
+        if(cullObject(BoundingSphere{light.position(), light.radius()}, camera_position, frustum))
+            continue;
+
+        visible_lights.push_back({
+            light.position(),
+            light.radius(),
+            light.color(),
+            0.0f
+        });
+    }
 
-    point_light_material.bind();
+    bind_frame_data(camera, viewport, u32(visible_lights.size()));
 
-    for (u32 i = 0; i < _point_lights.size(); i++) {
-        glm::mat4 light_transform = glm::mat4(1.0);
-        light_transform = glm::translate(light_transform, _point_lights[i].position());
-        light_transform = glm::scale(light_transform, glm::vec3(_point_lights[i].radius()));
+    TypedBuffer<shader::PointLight> light_buffer(nullptr, std::max(visible_lights.size(), size_t(1)));
+    if(!visible_lights.empty()) {
+        auto mapping = light_buffer.map(AccessType::WriteOnly);
+        std::copy(visible_lights.begin(), visible_lights.end(), mapping.data());
+    }
+    light_buffer.bind(BufferUsage::Storage, 1);
 
-        TypedBuffer<glm::mat4> model_buffer(&light_transform, 1);
-        model_buffer.bind(BufferUsage::Storage, 2);
-        
-        point_light_material.set_uniform("light_index", i);
-        _point_light_volume->draw();
+    // Everything has the same key: the commands run in recording order
+    CommandBuffer commands;
+    commands.draw_fullscreen(0, &sun_material);
+
+    // Every light is drawn twice: the first draw marks the pixels whose surface is inside the volume in the stencil,
+    // the second only shades those pixels (and clears the stencil for the next light).
+    for (u32 i = 0; i < visible_lights.size(); i++) {
+        commands.set_uniform(0, &light_stencil_material, HASH("light_index"), i);
+        commands.draw_mesh(0, &light_stencil_material, _point_light_volume.get());
+
+        commands.set_uniform(0, &point_light_material, HASH("light_index"), i);
+        commands.draw_mesh(0, &point_light_material, _point_light_volume.get());
     }
+
+    commands.submit();
 }
 
 }
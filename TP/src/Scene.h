@@ -5,33 +5,149 @@
 #include <PointLight.h>
 #include <Camera.h>
 #include <Framebuffer.h>
+#include <HiZBuffer.h>
+#include <DepthPrepass.h>
+#include <OcclusionRasterizer.h>
+#include <TransformHierarchy.h>
+#include <FrameAllocator.h>
 
 #include <vector>
 #include <memory>
 
 namespace OM3D {
 
+struct CullingSettings {
+    // Test against the previous frame depth
+    HiZBuffer* hiz = nullptr;
+
+    // Test against the occluders rasterized on the CPU
+    OcclusionRasterizer* software_occlusion = nullptr;
+
+    // Objects with a smaller projected radius are not drawn
+    float min_pixel_radius = 0.0f;
+
+    // Projected radius above which the full detail mesh is used, every next LOD is used at half the radius
+    float lod_pixel_radius = 256.0f;
+
+    // How far past a LOD boundary (in LODs) an object must go before switching, to avoid popping back and forth
+    float lod_hysteresis = 0.1f;
+};
+
+class TextureUploader;
+
+struct SceneLoadSettings {
+    // Number of simplified meshes to generate, in addition to the full detail one
+    u32 lod_count = 0;
+
+    // Stream the textures over the next frames instead of uploading them during the load
+    TextureUploader* texture_uploader = nullptr;
+};
+
+class Scene;
+
+// Stable across removals of other objects
+using ObjectId = u32;
+
+// Read only view of an object stored in a scene, invalidated when objects are added or removed
+class SceneObjectView {
+    public:
+        const glm::mat4& transform() const;
+        const BoundingSphere& world_bounding_sphere() const;
+        bool is_occluder() const;
+
+        MeshHandle mesh_handle() const;
+        MaterialHandle material_handle() const;
+
+        StaticMesh* get_mesh() const;
+        Material* get_material() const;
+
+    private:
+        friend class Scene;
+
+        SceneObjectView(const Scene* scene, u32 index);
+
+        const Scene* _scene = nullptr;
+        u32 _index = 0;
+};
+
 class Scene : NonMovable {
 
     public:
         Scene();
+        ~Scene();
+
+        static Result<std::unique_ptr<Scene>> from_gltf(const std::string& file_name, const SceneLoadSettings& settings = {});
 
-        static Result<std::unique_ptr<Scene>> from_gltf(const std::string& file_name);
+        // With an enabled depth_prepass, opaque objects first draw their depth, then shade with DrawMode::DepthEqual
+        void render(const Camera& camera, const Viewport& viewport, const CullingSettings& culling = {}, DepthPrepass* depth_prepass = nullptr) const;
+        // light_stencil_material marks the pixels lit by each point light, see StencilMode
+        void deferred_lighting(const Camera& camera, const Viewport& viewport, const Material& sun_material,
+                               Material& point_light_material, Material& light_stencil_material) const;
 
-        void render(const Camera& camera) const;
-        void deferred_lighting(const Camera& camera, const Material& sun_material,
-                               Material& point_light_material) const;
+        // Registered in the global pools, and removed from them with the scene
+        MeshHandle add_mesh(std::shared_ptr<StaticMesh> mesh);
+        MaterialHandle add_material(std::shared_ptr<Material> material);
 
-        void add_object(SceneObject obj);
+        ObjectId add_object(const SceneObject& obj);
+        // The object transform follows the node world matrix
+        ObjectId add_object(const SceneObject& obj, TransformHierarchy::NodeId node);
         void add_object(PointLight obj);
-        const SceneObject& get_object(int index) const;
+        // The last object takes the place of the removed one, ids of other objects are unchanged
+        void remove_object(ObjectId id);
+
+        bool contains_object(ObjectId id) const;
+        size_t object_count() const;
+        SceneObjectView get_object(ObjectId id) const;
+        void set_object_transform(ObjectId id, const glm::mat4& transform);
+
+        // Frustum, small object culling and LOD selection, fills visible with the indices of the visible objects
+        void cull_objects(const Camera& camera, const Viewport& viewport, const CullingSettings& culling, FrameVector<u32>& visible) const;
         void set_point_light_volume(std::shared_ptr<StaticMesh> volume);
 
+        TransformHierarchy& transform_hierarchy();
+        const TransformHierarchy& transform_hierarchy() const;
+
+        // Update the hierarchy and push the changed world matrices to the objects
+        void update_transforms();
+
     private:
-        std::vector<SceneObject> _objects;
+        friend class SceneObjectView;
+
+        enum ObjectFlags : u8 {
+            Occluder = 0x01,
+        };
+
+        void bind_frame_data(const Camera& camera, const Viewport& viewport, u32 point_light_count) const;
+        void update_object_bounds(u32 index);
+
+        // Objects are stored as parallel arrays, indexed by dense object index
+        std::vector<BoundingSphere> _object_bounds; // World space
+        std::vector<glm::mat4> _object_transforms;
+        std::vector<MeshHandle> _object_meshes;
+        std::vector<MaterialHandle> _object_materials;
+        std::vector<u8> _object_flags;
+        std::vector<u8> _object_lod_counts;
+        std::vector<ObjectId> _object_ids;
+
+        // Dense index of each object id, invalid_index for free ids
+        static constexpr u32 invalid_index = u32(-1);
+        std::vector<u32> _object_indices;
+        std::vector<ObjectId> _free_object_ids;
+
         std::vector<PointLight> _point_lights;
+
+        std::vector<MeshHandle> _meshes;
+        std::vector<MaterialHandle> _materials;
+
+        TransformHierarchy _transform_hierarchy;
+        // (node, object id), sorted by node when updating
+        std::vector<std::pair<TransformHierarchy::NodeId, ObjectId>> _node_objects;
+        bool _node_objects_sorted = true;
         glm::vec3 _sun_direction = glm::vec3(0.2f, 1.0f, 0.1f);
         std::shared_ptr<StaticMesh> _point_light_volume;
+
+        // LOD used by each object during the last frame
+        mutable std::vector<u8> _object_lods;
 };
 
 }
@@ -4,19 +4,21 @@
 
 namespace OM3D {
 
-SceneObject::SceneObject(std::shared_ptr<StaticMesh> mesh, std::shared_ptr<Material> material) :
-    _mesh(std::move(mesh)),
-    _material(std::move(material)) {
+SceneObject::SceneObject(MeshHandle mesh, MaterialHandle material) :
+    _mesh(mesh),
+    _material(material) {
 }
 
 void SceneObject::render() const {
-    if(!_material || !_mesh) {
+    Material* material = get_material();
+    const StaticMesh* mesh = get_mesh();
+    if(!material || !mesh) {
         return;
     }
 
-   _material->set_uniform(HASH("model"), transform());
-   _material->bind();
-    _mesh->draw();
+    material->set_uniform(HASH("model"), transform());
+    material->bind();
+    mesh->draw();
 }
 
 void SceneObject::set_transform(const glm::mat4& tr) {
@@ -28,15 +30,32 @@ const glm::mat4& SceneObject::transform() const {
 }
 
 BoundingSphere SceneObject::boundingSphere() const {
-    return _mesh->boundingSphere();
+    return get_mesh()->boundingSphere();
 }
 
-std::shared_ptr<StaticMesh> SceneObject::get_mesh() const {
+void SceneObject::set_occluder(bool occluder) {
+    _occluder = occluder;
+}
+
+bool SceneObject::is_occluder() const {
+    const StaticMesh* mesh = get_mesh();
+    return _occluder && mesh && mesh->occluder_mesh();
+}
+
+MeshHandle SceneObject::mesh_handle() const {
     return _mesh;
 }
 
-std::shared_ptr<Material> SceneObject::get_material() const {
+MaterialHandle SceneObject::material_handle() const {
     return _material;
 }
 
+StaticMesh* SceneObject::get_mesh() const {
+    return ResourcePool<StaticMesh>::global().get(_mesh);
+}
+
+Material* SceneObject::get_material() const {
+    return ResourcePool<Material>::global().get(_material);
+}
+
 }
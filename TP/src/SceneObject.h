@@ -3,6 +3,7 @@
 
 #include <StaticMesh.h>
 #include <Material.h>
+#include <ResourcePool.h>
 
 #include <memory>
 
@@ -13,7 +14,8 @@ namespace OM3D {
 class SceneObject : NonCopyable {
 
     public:
-        SceneObject(std::shared_ptr<StaticMesh> mesh = nullptr, std::shared_ptr<Material> material = nullptr);
+        // Handles into the global mesh and material pools
+        SceneObject(MeshHandle mesh = {}, MaterialHandle material = {});
 
         void render() const;
 
@@ -22,14 +24,24 @@ class SceneObject : NonCopyable {
 
         BoundingSphere boundingSphere() const;
 
-        std::shared_ptr<StaticMesh> get_mesh() const;
-        std::shared_ptr<Material> get_material() const;
+        // Occluders are rasterized by the software occlusion culling, their mesh needs an occluder mesh
+        void set_occluder(bool occluder);
+        bool is_occluder() const;
+
+        MeshHandle mesh_handle() const;
+        MaterialHandle material_handle() const;
+
+        // Pool lookups, nullptr if the resource was removed
+        StaticMesh* get_mesh() const;
+        Material* get_material() const;
 
     private:
         glm::mat4 _transform = glm::mat4(1.0f);
 
-        std::shared_ptr<StaticMesh> _mesh;
-        std::shared_ptr<Material> _material;
+        MeshHandle _mesh;
+        MaterialHandle _material;
+
+        bool _occluder = false;
 };
 
 }
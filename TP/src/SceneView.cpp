@@ -13,16 +13,16 @@ const Camera& SceneView::camera() const {
     return _camera;
 }
 
-void SceneView::render() const {
+void SceneView::render(const Viewport& viewport, const CullingSettings& culling, DepthPrepass* depth_prepass) const {
     if(_scene) {
-        _scene->render(_camera);
+        _scene->render(_camera, viewport, culling, depth_prepass);
     }
 }
 
-void SceneView::deferred_lighting(const Material& sun_material,
-                                  Material& point_light_material) const {
+void SceneView::deferred_lighting(const Viewport& viewport, const Material& sun_material,
+                                  Material& point_light_material, Material& light_stencil_material) const {
     if (_scene) {
-        _scene->deferred_lighting(_camera, sun_material, point_light_material);
+        _scene->deferred_lighting(_camera, viewport, sun_material, point_light_material, light_stencil_material);
     }
 }
 
@@ -13,9 +13,9 @@ class SceneView {
         Camera& camera();
         const Camera& camera() const;
 
-        void render() const;
-        void deferred_lighting(const Material& sun_material,
-                               Material& point_light_material) const;
+        void render(const Viewport& viewport, const CullingSettings& culling = {}, DepthPrepass* depth_prepass = nullptr) const;
+        void deferred_lighting(const Viewport& viewport, const Material& sun_material,
+                               Material& point_light_material, Material& light_stencil_material) const;
 
     private:
         const Scene* _scene = nullptr;
@@ -1,11 +1,20 @@
 #include "Scene.h"
 #include "StaticMesh.h"
+#include "MeshSimplifier.h"
+#include "VertexDecoder.h"
+#include "TangentGenerator.h"
+#include "MeshoptDecoder.h"
+#include "ThreadPool.h"
+#include "TextureUploader.h"
+#include "MappedFile.h"
 
 #include <glm/gtc/quaternion.hpp>
 
 #include <utils.h>
 
 #include <iostream>
+#include <limits>
+#include <cstring>
 
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -27,87 +36,79 @@ static size_t component_count(int type) {
     }
 }
 
-static bool decode_attrib_buffer(const tinygltf::Model& gltf, const std::string& name, const tinygltf::Accessor& accessor, Span<Vertex> vertices) {
-    const tinygltf::BufferView& buffer = gltf.bufferViews[accessor.bufferView];
+// Contents of every buffer of the model, the GLB binary chunk is read in place from the mapped file.
+// Meshopt compressed views are decoded in their own storage, so the buffers are never copied.
+struct BufferData {
+    std::vector<Span<const u8>> buffers;
+    // Indexed by buffer view, empty for the views read from their buffer
+    std::vector<std::vector<u8>> decoded_views;
+
+    // Bytes of a buffer view, empty if it is out of its buffer
+    Span<const u8> view(const tinygltf::Model& gltf, int view_index) const {
+        if(size_t(view_index) < decoded_views.size() && !decoded_views[view_index].empty()) {
+            return decoded_views[view_index];
+        }
 
-    if(accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
-        std::cerr << "Unsupported component type (" << accessor.componentType << ") for \"" << name << "\"" << std::endl;
-        return false;
+        const tinygltf::BufferView& view = gltf.bufferViews[view_index];
+        if(size_t(view.buffer) >= buffers.size() || view.byteOffset + view.byteLength > buffers[view.buffer].size()) {
+            return {};
+        }
+        return Span<const u8>(buffers[view.buffer].data() + view.byteOffset, view.byteLength);
     }
+};
 
-    [[maybe_unused]]
-    const size_t vertex_count = vertices.size();
-
-    auto decode_attribs =  [&](auto* vertex_elems) {
-        using attrib_type = std::remove_reference_t<decltype(vertex_elems[0])>;
-        using value_type = typename attrib_type::value_type;
-        static constexpr size_t size = sizeof(attrib_type) / sizeof(value_type);
-
-        const size_t components = component_count(accessor.type);
-        const bool normalize = accessor.normalized;
-
-        DEBUG_ASSERT(accessor.count == vertex_count);
+// Float, or the integer types allowed by KHR_mesh_quantization
+static bool is_supported_component_type(const std::string& name, const tinygltf::Accessor& accessor) {
+    const ComponentType type = ComponentType(accessor.componentType);
+    if(type == ComponentType::Float) {
+        return true;
+    }
 
-        if(components != size) {
-            std::cerr << "Expected VEC" << size << " attribute, got VEC" << components << std::endl;
-        }
+    const bool is_8_or_16_bits = type == ComponentType::Byte || type == ComponentType::UnsignedByte || type == ComponentType::Short || type == ComponentType::UnsignedShort;
+    if(name == "POSITION" || name == "TEXCOORD_0") {
+        return is_8_or_16_bits;
+    }
+    if(name == "NORMAL" || name == "TANGENT") {
+        return accessor.normalized && (type == ComponentType::Byte || type == ComponentType::Short);
+    }
+    if(name == "COLOR_0") {
+        return accessor.normalized && (type == ComponentType::UnsignedByte || type == ComponentType::UnsignedShort);
+    }
+    return false;
+}
 
-        const size_t min_size = std::min(size, components);
-        auto convert = [=](const u8* data) {
-            attrib_type vec;
-            for(size_t i = 0; i != min_size; ++i) {
-                vec[int(i)] = reinterpret_cast<const value_type*>(data)[i];
-            }
-            if(normalize) {
-                if constexpr(size == 4) {
-                    const glm::vec3 n = glm::normalize(glm::vec3(vec));
-                    vec[0] = n[0];
-                    vec[1] = n[1];
-                    vec[2] = n[2];
-                } else {
-                    vec = glm::normalize(vec);
-                }
-            }
-            return vec;
-        };
+// Describes where the accessor elements are, false if they do not fit in the buffer
+static bool attribute_stream(const tinygltf::Model& gltf, const BufferData& buffers, const std::string& name, const tinygltf::Accessor& accessor, AttributeStream& stream) {
+    const tinygltf::BufferView& buffer = gltf.bufferViews[accessor.bufferView];
 
-        {
-            u8* out_begin = reinterpret_cast<u8*>(vertex_elems);
+    if(!is_supported_component_type(name, accessor)) {
+        std::cerr << "Unsupported component type (" << accessor.componentType << (accessor.normalized ? ", normalized" : "") << ") for \"" << name << "\"" << std::endl;
+        return false;
+    }
 
-            const auto& in_buffer = gltf.buffers[buffer.buffer].data;
-            const u8* in_begin = in_buffer.data() + buffer.byteOffset + accessor.byteOffset;
-            const size_t attrib_size = components * sizeof(value_type);
-            const size_t input_stride = buffer.byteStride ? buffer.byteStride : attrib_size;
+    const Span<const u8> in_buffer = buffers.view(gltf, accessor.bufferView);
+    const size_t components = component_count(accessor.type);
+    const size_t attrib_size = components * component_size(ComponentType(accessor.componentType));
+    const size_t offset = accessor.byteOffset;
 
-            for(size_t i = 0; i != accessor.count; ++i) {
-                const u8* attrib = in_begin + i * input_stride;
-                DEBUG_ASSERT(attrib < in_buffer.data() + in_buffer.size());
-                *reinterpret_cast<attrib_type*>(out_begin + i * sizeof(Vertex)) = convert(attrib);
-            }
-        }
-    };
+    stream.data = in_buffer.data() + offset;
+    stream.stride = buffer.byteStride ? buffer.byteStride : attrib_size;
+    stream.components = u32(components);
+    stream.component_type = ComponentType(accessor.componentType);
+    stream.normalized = accessor.normalized;
 
-    if(name == "POSITION") {
-        decode_attribs(&vertices[0].position);
-    } else if(name == "NORMAL") {
-        decode_attribs(&vertices[0].normal);
-    } else if(name == "TANGENT") {
-        decode_attribs(&vertices[0].tangent_bitangent_sign);
-    } else if(name == "TEXCOORD_0") {
-        decode_attribs(&vertices[0].uv);
-    } else if(name == "COLOR_0") {
-        decode_attribs(&vertices[0].color);
-    } else {
-        std::cerr << "Attribute \"" << name << "\" is not supported" << std::endl;
+    if(offset + (accessor.count - 1) * stream.stride + attrib_size > in_buffer.size()) {
+        std::cerr << "Attribute \"" << name << "\" is out of its buffer" << std::endl;
+        return false;
     }
     return true;
 }
 
-static bool decode_index_buffer(const tinygltf::Model& gltf, const tinygltf::Accessor& accessor, Span<u32> indices) {
+static bool decode_index_buffer(const tinygltf::Model& gltf, const BufferData& buffers, const tinygltf::Accessor& accessor, Span<u32> indices) {
     const tinygltf::BufferView& buffer = gltf.bufferViews[accessor.bufferView];
 
     auto decode_indices = [&](u32 elem_size, auto convert_index) {
-        const u8* in_buffer = gltf.buffers[buffer.buffer].data.data() + buffer.byteOffset + accessor.byteOffset;
+        const u8* in_buffer = buffers.view(gltf, accessor.bufferView).data() + accessor.byteOffset;
         const size_t input_stride = buffer.byteStride ? buffer.byteStride : elem_size;
 
         for(size_t i = 0; i != accessor.count; ++i) {
@@ -139,10 +140,11 @@ static bool decode_index_buffer(const tinygltf::Model& gltf, const tinygltf::Acc
     return true;
 }
 
-static Result<MeshData> build_mesh_data(const tinygltf::Model& gltf, const tinygltf::Primitive& prim) {
+static Result<MeshData> build_mesh_data(const tinygltf::Model& gltf, const BufferData& buffers, const tinygltf::Primitive& prim) {
     std::vector<Vertex> vertices;
+    VertexStreams streams;
     for(auto&& [name, id] : prim.attributes) {
-        tinygltf::Accessor accessor = gltf.accessors[id];
+        const tinygltf::Accessor& accessor = gltf.accessors[id];
         if(!accessor.count) {
             continue;
         }
@@ -157,15 +159,33 @@ static Result<MeshData> build_mesh_data(const tinygltf::Model& gltf, const tinyg
             return {false, {}};
         }
 
-        if(!decode_attrib_buffer(gltf, name, accessor, vertices)) {
+        AttributeStream* stream = nullptr;
+        if(name == "POSITION") {
+            stream = &streams.position;
+        } else if(name == "NORMAL") {
+            stream = &streams.normal;
+        } else if(name == "TANGENT") {
+            stream = &streams.tangent_bitangent_sign;
+        } else if(name == "TEXCOORD_0") {
+            stream = &streams.uv;
+        } else if(name == "COLOR_0") {
+            stream = &streams.color;
+        } else {
+            std::cerr << "Attribute \"" << name << "\" is not supported" << std::endl;
+            continue;
+        }
+
+        if(!attribute_stream(gltf, buffers, name, accessor, *stream)) {
             return {false, {}};
         }
     }
 
+    decode_vertices(streams, vertices);
+
 
     std::vector<u32> indices;
     {
-        tinygltf::Accessor accessor = gltf.accessors[prim.indices];
+        const tinygltf::Accessor& accessor = gltf.accessors[prim.indices];
         if(!accessor.count || accessor.sparse.isSparse) {
             return {false, {}};
         }
@@ -176,131 +196,296 @@ static Result<MeshData> build_mesh_data(const tinygltf::Model& gltf, const tinyg
             return {false, {}};
         }
 
-        if(!decode_index_buffer(gltf, accessor, indices)) {
+        if(!decode_index_buffer(gltf, buffers, accessor, indices)) {
             return {false, {}};
         }
     }
 
-    return {true, MeshData{std::move(vertices), std::move(indices)}};
+    return {true, MeshData{std::move(vertices), std::move(indices), {}}};
 }
 
-static Result<TextureData> build_texture_data(const tinygltf::Image& image, bool as_sRGB) {
-    if(image.bits != 8 && image.pixel_type != TINYGLTF_COMPONENT_TYPE_BYTE && image.pixel_type != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE) {
-        std::cerr << "Unsupported image format (pixel type)" << std::endl;
-        return {false, {}};
+// Binary chunk of a GLB file, empty if there is none
+static Span<const u8> glb_binary_chunk(Span<const u8> bytes) {
+    const auto read_u32 = [&](size_t offset) {
+        u32 value = 0;
+        std::memcpy(&value, bytes.data() + offset, sizeof(u32));
+        return value;
+    };
+
+    if(bytes.size() < 20) {
+        return {};
     }
 
-    ImageFormat format = ImageFormat::RGBA8_UNORM;
-    switch(image.component) {
-        case 3:
-            format = as_sRGB ? ImageFormat::RGB8_sRGB : ImageFormat::RGB8_UNORM;
-        break;
+    // Header (12 bytes), then JSON chunk length, type and data, then binary chunk length, type and data
+    const size_t binary_header = 20 + size_t(read_u32(12));
+    if(binary_header + 8 > bytes.size() || read_u32(binary_header + 4) != 0x004E4942) { // "BIN\0"
+        return {};
+    }
 
-        case 4:
-            format = as_sRGB ? ImageFormat::RGBA8_sRGB : ImageFormat::RGBA8_UNORM;
-        break;
+    const size_t length = std::min(size_t(read_u32(binary_header)), bytes.size() - (binary_header + 8));
+    return Span<const u8>(bytes.data() + binary_header + 8, length);
+}
 
-        default:
-            std::cerr << "Unsupported image format (components)" << std::endl;
-            return {false, {}};
+// Decodes the EXT_meshopt_compression buffer views in place of their (usually empty) fallback buffer, one view per task.
+// Returns false if any view can not be decoded.
+static bool decode_meshopt_buffer_views(const std::string& file_name, tinygltf::Model& gltf, BufferData& buffers) {
+    struct CompressedView {
+        Span<const u8> encoded;
+        u8* destination = nullptr;
+        size_t count = 0;
+        size_t stride = 0;
+        MeshoptMode mode = MeshoptMode::Attributes;
+        MeshoptFilter filter = MeshoptFilter::None;
+        int index = 0;
+    };
+
+    const auto number = [](const tinygltf::Value& ext, const char* name, size_t default_value) {
+        return ext.Has(name) && ext.Get(name).IsNumber() ? size_t(ext.Get(name).GetNumberAsDouble()) : default_value;
+    };
+    const auto string = [](const tinygltf::Value& ext, const char* name, const char* default_value) {
+        return ext.Has(name) && ext.Get(name).IsString() ? ext.Get(name).Get<std::string>() : std::string(default_value);
+    };
+
+    // Every view is decoded in its own storage: the destination buffer is usually an empty fallback,
+    // or the mapped GLB binary chunk which must not be copied
+    buffers.decoded_views.resize(gltf.bufferViews.size());
+
+    std::vector<CompressedView> views;
+    size_t encoded_bytes = 0;
+    size_t decoded_bytes = 0;
+    for(size_t i = 0; i != gltf.bufferViews.size(); ++i) {
+        const tinygltf::BufferView& view = gltf.bufferViews[i];
+        const auto it = view.extensions.find("EXT_meshopt_compression");
+        if(it == view.extensions.end()) {
+            continue;
+        }
+
+        const tinygltf::Value& ext = it->second;
+        const size_t source = number(ext, "buffer", gltf.buffers.size());
+        const size_t offset = number(ext, "byteOffset", 0);
+        const size_t length = number(ext, "byteLength", 0);
+
+        CompressedView compressed;
+        compressed.count = number(ext, "count", 0);
+        compressed.stride = number(ext, "byteStride", 0);
+        compressed.index = int(i);
+
+        const std::string mode = string(ext, "mode", "");
+        const std::string filter = string(ext, "filter", "NONE");
+        if(mode == "ATTRIBUTES") {
+            compressed.mode = MeshoptMode::Attributes;
+        } else if(mode == "TRIANGLES") {
+            compressed.mode = MeshoptMode::Triangles;
+        } else if(mode == "INDICES") {
+            compressed.mode = MeshoptMode::Indices;
+        } else {
+            std::cerr << "Unknown meshopt mode \"" << mode << "\" for buffer view " << i << std::endl;
+            return false;
+        }
+        if(filter == "NONE") {
+            compressed.filter = MeshoptFilter::None;
+        } else if(filter == "OCTAHEDRAL") {
+            compressed.filter = MeshoptFilter::Octahedral;
+        } else if(filter == "QUATERNION") {
+            compressed.filter = MeshoptFilter::Quaternion;
+        } else if(filter == "EXPONENTIAL") {
+            compressed.filter = MeshoptFilter::Exponential;
+        } else {
+            std::cerr << "Unknown meshopt filter \"" << filter << "\" for buffer view " << i << std::endl;
+            return false;
+        }
+
+        const size_t decoded_size = compressed.count * compressed.stride;
+        if(source >= buffers.buffers.size() || offset + length > buffers.buffers[source].size() ||
+           decoded_size > view.byteLength) {
+            std::cerr << "Meshopt compressed buffer view " << i << " is out of its buffers" << std::endl;
+            return false;
+        }
+
+        std::vector<u8>& decoded = buffers.decoded_views[i];
+        decoded.resize(view.byteLength);
+        compressed.encoded = Span<const u8>(buffers.buffers[source].data() + offset, length);
+        compressed.destination = decoded.data();
+        views.push_back(compressed);
+
+        encoded_bytes += length;
+        decoded_bytes += decoded_size;
+    }
+
+    if(views.empty()) {
+        return true;
     }
 
-    auto data = std::make_unique<u8[]>(image.image.size());
-    std::copy(image.image.begin(), image.image.end(), data.get());
+    std::vector<u8> failed(views.size(), false);
+    ThreadPool::global().parallel_for(views.size(), [&](size_t i) {
+        const CompressedView& view = views[i];
+        failed[i] = !decode_meshopt(view.mode, view.filter, view.destination, view.count, view.stride, view.encoded);
+    });
+
+    for(size_t i = 0; i != views.size(); ++i) {
+        if(failed[i]) {
+            std::cerr << "Unable to decode meshopt compressed buffer view " << views[i].index << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << file_name << ": " << views.size() << " meshopt compressed buffer views, "
+              << decoded_bytes / 1024 << "KB decoded from " << encoded_bytes / 1024 << "KB" << std::endl;
+    return true;
+}
+
+// Images are decoded later, in parallel and only if they are used
+static bool store_encoded_image(tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*) {
+    image->image.assign(bytes, bytes + size);
+    image->as_is = true;
+    return true;
+}
 
-    return {true, TextureData{std::move(data), glm::uvec2(image.width, image.height), format}};
+// Image index of a material texture, -1 if there is none or it can not be used
+template<typename T>
+static int texture_image_index(const tinygltf::Model& gltf, const T& texture_info) {
+    if(texture_info.texCoord != 0 || texture_info.index < 0) {
+        return -1;
+    }
+    return gltf.textures[texture_info.index].source;
 }
 
 
-static glm::mat4 parse_node_matrix(const tinygltf::Node& node) {
-    glm::vec3 translation(0.0f, 0.0f, 0.0f);
+static Transform parse_node_transform(const tinygltf::Node& node) {
+    Transform transform;
     for(u32 k = 0; k != node.translation.size(); ++k) {
-        translation[k] = float(node.translation[k]);
+        transform.translation[k] = float(node.translation[k]);
     }
 
-    glm::vec3 scale(1.0f, 1.0f, 1.0f);
     for(u32 k = 0; k != node.scale.size(); ++k) {
-        scale[k] = float(node.scale[k]);
+        transform.scale[k] = float(node.scale[k]);
     }
 
-    glm::vec4 rotation(0.0f, 0.0f, 0.0f, 1.0f);
-    for(u32 k = 0; k != node.rotation.size(); ++k) {
-        rotation[k] = float(node.rotation[k]);
+    if(node.rotation.size() == 4) {
+        transform.rotation = glm::quat(float(node.rotation[3]), float(node.rotation[0]), float(node.rotation[1]), float(node.rotation[2]));
     }
 
-    const glm::tquat<float> q(rotation.w, rotation.x, rotation.y, rotation.z);
-    return glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(q) * glm::scale(glm::mat4(1.0f), scale);
-}
-
-static glm::mat4 base_transform() {
-    return glm::mat4(1.0f);
+    return transform;
 }
 
-static void parse_node_transforms(int node_index, const tinygltf::Model& gltf, std::unordered_map<int, glm::mat4>& node_transforms, const glm::mat4& parent_transform = base_transform()) {
+// Depth first, so parents are added before their children
+static void add_node_hierarchy(int node_index, const tinygltf::Model& gltf, TransformHierarchy& hierarchy, std::vector<std::pair<int, TransformHierarchy::NodeId>>& nodes, TransformHierarchy::NodeId parent = TransformHierarchy::no_parent) {
     const tinygltf::Node& node = gltf.nodes[node_index];
-    const glm::mat4 transform = parent_transform * parse_node_matrix(node);
-    node_transforms[node_index] = transform;
+    const TransformHierarchy::NodeId id = hierarchy.add_node(parse_node_transform(node), parent);
+    nodes.emplace_back(node_index, id);
     for(int child : node.children)  {
-        parse_node_transforms(child, gltf, node_transforms, transform);
+        add_node_hierarchy(child, gltf, hierarchy, nodes, id);
     }
 }
 
-static void compute_tangents(MeshData& mesh) {
-    for(Vertex& vert : mesh.vertices) {
-        vert.tangent_bitangent_sign = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+// Objects bigger than this fraction of the scene are used as occluders by the software occlusion culling
+static constexpr float occluder_min_scene_ratio = 0.05f;
+
+static Result<BoundingSphere> primitive_world_bounds(const tinygltf::Model& gltf, const tinygltf::Primitive& prim, const glm::mat4& transform) {
+    const auto it = prim.attributes.find("POSITION");
+    if(it == prim.attributes.end()) {
+        return {false, {}};
     }
 
-    for(size_t i = 0; i < mesh.indices.size(); i += 3) {
-        const u32 tri[] = {
-            mesh.indices[i + 0],
-            mesh.indices[i + 1],
-            mesh.indices[i + 2]
-        };
+    const tinygltf::Accessor& accessor = gltf.accessors[it->second];
+    if(accessor.minValues.size() != 3 || accessor.maxValues.size() != 3) {
+        return {false, {}};
+    }
 
-        const glm::vec3 edges[] = {
-            mesh.vertices[tri[1]].position - mesh.vertices[tri[0]].position,
-            mesh.vertices[tri[2]].position - mesh.vertices[tri[0]].position
-        };
+    const glm::vec3 min(accessor.minValues[0], accessor.minValues[1], accessor.minValues[2]);
+    const glm::vec3 max(accessor.maxValues[0], accessor.maxValues[1], accessor.maxValues[2]);
+    const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
 
-        const glm::vec2 uvs[] = {
-            mesh.vertices[tri[0]].uv,
-            mesh.vertices[tri[1]].uv,
-            mesh.vertices[tri[2]].uv
-        };
+    const glm::vec3 center = transform * glm::vec4((min + max) * 0.5f, 1.0f);
+    return {true, BoundingSphere{center, glm::length(max - min) * 0.5f * scale}};
+}
 
-        const float dt[] = {
-            uvs[1].y - uvs[0].y,
-            uvs[2].y - uvs[0].y
-        };
+static bool is_occluder(const tinygltf::Node& node, const Result<BoundingSphere>& bounds, float min_radius) {
+    // Can be forced with {"extras": {"occluder": true/false}}
+    if(node.extras.Has("occluder") && node.extras.Get("occluder").IsBool()) {
+        return node.extras.Get("occluder").Get<bool>();
+    }
+    return bounds.is_ok && bounds.value.radius >= min_radius;
+}
 
-        const glm::vec3 tangent = -glm::normalize((edges[0] * dt[1]) - (edges[1] * dt[0]));
-        mesh.vertices[tri[0]].tangent_bitangent_sign += glm::vec4(tangent, 0.0f);
-        mesh.vertices[tri[1]].tangent_bitangent_sign += glm::vec4(tangent, 0.0f);
-        mesh.vertices[tri[2]].tangent_bitangent_sign += glm::vec4(tangent, 0.0f);
+// Integer positions are kept as 16 bits integers on the GPU, false for float positions
+static bool position_quantization(const tinygltf::Model& gltf, const tinygltf::Primitive& prim, PositionQuantization& quantization) {
+    const auto it = prim.attributes.find("POSITION");
+    if(it == prim.attributes.end()) {
+        return false;
     }
 
-    for(Vertex& vert : mesh.vertices) {
-        const glm::vec3 tangent = vert.tangent_bitangent_sign;
-        vert.tangent_bitangent_sign = glm::vec4(glm::normalize(tangent), 1.0f);
+    const tinygltf::Accessor& accessor = gltf.accessors[it->second];
+    switch(ComponentType(accessor.componentType)) {
+        case ComponentType::Byte:
+            quantization = {accessor.normalized ? 1.0f / 127.0f : 1.0f, 0.0f};
+            return true;
+        case ComponentType::UnsignedByte:
+            quantization = {accessor.normalized ? 1.0f / 255.0f : 1.0f, 0.0f};
+            return true;
+        case ComponentType::Short:
+            quantization = {accessor.normalized ? 1.0f / 32767.0f : 1.0f, 0.0f};
+            return true;
+        case ComponentType::UnsignedShort:
+            // Shifted to fit in signed integers
+            quantization = accessor.normalized ? PositionQuantization{1.0f / 65535.0f, 32768.0f / 65535.0f} : PositionQuantization{1.0f, 32768.0f};
+            return true;
+        default:
+            return false;
     }
 }
 
+// Every LOD targets half the triangles of the previous one
+static void generate_lods(MeshData& mesh, u32 lod_count) {
+    for(u32 i = 0; i != lod_count; ++i) {
+        const std::vector<u32>& source = mesh.lods.empty() ? mesh.indices : mesh.lods.back();
+        const size_t target = (source.size() / 6) * 3;
+        if(target < 3) {
+            break;
+        }
+
+        SimplifiedIndices lod = simplify_mesh(mesh.vertices, source, target);
 
-Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
+        // Simplification is blocked (by seams or borders), don't waste memory on nearly identical LODs
+        if(lod.indices.empty() || lod.indices.size() * 10 > source.size() * 9) {
+            break;
+        }
+
+        mesh.lods.push_back(std::move(lod.indices));
+    }
+}
+
+Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name, const SceneLoadSettings& settings) {
     const double time = program_time();
     DEFER(std::cout << file_name << " loaded in " << std::round((program_time() - time) * 100.0) / 100.0 << "s" << std::endl);
 
     tinygltf::TinyGLTF ctx;
     tinygltf::Model gltf;
 
+    ctx.SetImageLoader(store_encoded_image, nullptr);
+
+    // Binary files are mapped, and their binary chunk is read in place instead of being copied
+    MappedFile mapped_file;
+    Span<const u8> binary_chunk;
+
     {
         std::string err;
         std::string warn;
 
-        const bool is_ascii = ends_with(file_name, ".gltf");
-        const bool ok = is_ascii
-                ? ctx.LoadASCIIFromFile(&gltf, &err, &warn, file_name)
-                : ctx.LoadBinaryFromFile(&gltf, &err, &warn, file_name);
+        bool ok = false;
+        if(ends_with(file_name, ".gltf")) {
+            ok = ctx.LoadASCIIFromFile(&gltf, &err, &warn, file_name);
+        } else if(auto r = MappedFile::open(file_name); r.is_ok) {
+            mapped_file = std::move(r.value);
+            const Span<const u8> bytes = mapped_file.data();
+            binary_chunk = glb_binary_chunk(bytes);
+
+            const std::string base_dir = file_name.substr(0, file_name.find_last_of("/\\") + 1);
+            ctx.SetReferenceBinaryChunk(true);
+            ok = ctx.LoadBinaryFromMemory(&gltf, &err, &warn, bytes.data(), u32(bytes.size()), base_dir);
+        } else {
+            err = "Unable to open file";
+        }
 
         if(!err.empty()) {
             std::cerr << "Error while loading gltf: " << err << std::endl;
@@ -314,36 +499,129 @@ Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
         }
     }
 
+    BufferData buffers;
+    for(const tinygltf::Buffer& buffer : gltf.buffers) {
+        // Only the first buffer can be the binary chunk, other buffers without uri are meshopt fallbacks
+        const bool is_binary_chunk = buffers.buffers.empty() && buffer.uri.empty() && !binary_chunk.is_empty();
+        buffers.buffers.emplace_back(is_binary_chunk ? binary_chunk : Span<const u8>(buffer.data));
+    }
+
+    if(!decode_meshopt_buffer_views(file_name, gltf, buffers)) {
+        return {false, {}};
+    }
+
     std::cout << file_name << " parsed in " << std::round((program_time() - time) * 100.0) / 100.0 << "s" << std::endl;
 
     auto scene = std::make_unique<Scene>();
 
     std::unordered_map<int, std::shared_ptr<Texture>> textures;
-    std::unordered_map<int, std::shared_ptr<Material>> materials;
-    std::unordered_map<int, glm::mat4> node_transforms;
+    // Primitives without material use -1
+    std::unordered_map<int, MaterialHandle> materials;
 
+    // (gltf node, hierarchy node) for every node of the scene
+    std::vector<std::pair<int, TransformHierarchy::NodeId>> nodes;
     {
-        std::vector<int> node_indices;
+        std::vector<int> root_indices;
         if(gltf.defaultScene >= 0) {
-            node_indices = gltf.scenes[gltf.defaultScene].nodes;
+            root_indices = gltf.scenes[gltf.defaultScene].nodes;
         } else {
+            std::vector<bool> is_child(gltf.nodes.size(), false);
+            for(const tinygltf::Node& node : gltf.nodes) {
+                for(int child : node.children) {
+                    is_child[child] = true;
+                }
+            }
             for(u32 i = 0; i != gltf.nodes.size(); ++i) {
-                node_indices.push_back(i);
-                node_transforms[i] = base_transform();
+                if(!is_child[i]) {
+                    root_indices.push_back(i);
+                }
             }
         }
 
-        for(int node : node_indices) {
-            parse_node_transforms(node, gltf, node_transforms);
+        for(int root : root_indices) {
+            add_node_hierarchy(root, gltf, scene->transform_hierarchy(), nodes);
         }
+        scene->transform_hierarchy().update();
     }
 
-    for(auto [node_index, node_transform] : node_transforms) {
+    // Decode the images used by the materials, the first use decides the color space
+    std::vector<Result<TextureData>> images(gltf.images.size());
+    {
+        std::vector<bool> used(gltf.images.size(), false);
+        std::vector<std::pair<int, bool>> to_decode;
+        for(auto [node_index, node_id] : nodes) {
+            const int mesh_index = gltf.nodes[node_index].mesh;
+            if(mesh_index < 0) {
+                continue;
+            }
+            for(const tinygltf::Primitive& prim : gltf.meshes[mesh_index].primitives) {
+                if(prim.mode != TINYGLTF_MODE_TRIANGLES || prim.material < 0) {
+                    continue;
+                }
+                const tinygltf::Material& material = gltf.materials[prim.material];
+                const std::pair<int, bool> textures[] = {
+                    {texture_image_index(gltf, material.pbrMetallicRoughness.baseColorTexture), true},
+                    {texture_image_index(gltf, material.normalTexture), false},
+                };
+                for(const auto& [index, as_sRGB] : textures) {
+                    if(index >= 0 && !used[index]) {
+                        used[index] = true;
+                        to_decode.emplace_back(index, as_sRGB);
+                    }
+                }
+            }
+        }
+
+        ThreadPool::global().parallel_for(to_decode.size(), [&](size_t i) {
+            const auto [index, as_sRGB] = to_decode[i];
+            tinygltf::Image& image = gltf.images[index];
+            images[index] = TextureData::from_memory(image.image, as_sRGB);
+            std::vector<unsigned char>().swap(image.image);
+        });
+
+        for(const auto& [index, as_sRGB] : to_decode) {
+            if(!images[index].is_ok) {
+                std::cerr << "Unable to decode image " << index << " (" << gltf.images[index].uri << ")" << std::endl;
+            }
+        }
+    }
+
+    float occluder_min_radius = 0.0f;
+    {
+        glm::vec3 scene_min(std::numeric_limits<float>::max());
+        glm::vec3 scene_max(-std::numeric_limits<float>::max());
+        for(auto [node_index, node_id] : nodes) {
+            const tinygltf::Node& node = gltf.nodes[node_index];
+            if(node.mesh < 0) {
+                continue;
+            }
+            const glm::mat4& node_transform = scene->transform_hierarchy().world_matrix(node_id);
+            for(const tinygltf::Primitive& prim : gltf.meshes[node.mesh].primitives) {
+                if(const auto bounds = primitive_world_bounds(gltf, prim, node_transform); bounds.is_ok) {
+                    scene_min = glm::min(scene_min, bounds.value.center - bounds.value.radius);
+                    scene_max = glm::max(scene_max, bounds.value.center + bounds.value.radius);
+                }
+            }
+        }
+        if(scene_min.x <= scene_max.x) {
+            occluder_min_radius = glm::length(scene_max - scene_min) * 0.5f * occluder_min_scene_ratio;
+        }
+    }
+
+    // KHR_mesh_quantization savings, in vertex memory
+    size_t quantized_meshes = 0;
+    size_t quantized_bytes = 0;
+    size_t unquantized_bytes = 0;
+
+    for(auto [node_index, node_id] : nodes) {
         const tinygltf::Node& node = gltf.nodes[node_index];
         if(node.mesh < 0) {
             continue;
         }
 
+        // Copied: quantized meshes add nodes to the hierarchy
+        const glm::mat4 node_transform = scene->transform_hierarchy().world_matrix(node_id);
+
         const tinygltf::Mesh& mesh = gltf.meshes[node.mesh];
 
         for(size_t j = 0; j != mesh.primitives.size(); ++j) {
@@ -353,49 +631,50 @@ Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
                 continue;
             }
 
-            auto mesh = build_mesh_data(gltf, prim);
+            auto mesh = build_mesh_data(gltf, buffers, prim);
             if(!mesh.is_ok) {
                 return {false, {}};
             }
 
-            if(mesh.value.vertices[0].tangent_bitangent_sign == glm::vec4(0.0f)) {
-                compute_tangents(mesh.value);
+            if(prim.attributes.find("TANGENT") == prim.attributes.end()) {
+                generate_tangents(mesh.value.vertices, mesh.value.indices);
             }
 
-            std::shared_ptr<Material> material;
-            if(prim.material >= 0) {
-                auto& mat = materials[prim.material];
+            generate_lods(mesh.value, settings.lod_count);
 
-                if(!mat) {
+            MaterialHandle& material = materials[std::max(prim.material, -1)];
+            if(!material.is_valid()) {
+                std::shared_ptr<Material> mat = Material::empty_material();
+                if(prim.material >= 0) {
                     const auto& albedo_info = gltf.materials[prim.material].pbrMetallicRoughness.baseColorTexture;
                     const auto& normal_info = gltf.materials[prim.material].normalTexture;
 
-                    auto load_texture = [&](auto texture_info, bool as_sRGB) -> std::shared_ptr<Texture> {
+                    // clear_color is used until a streamed texture is uploaded
+                    auto load_texture = [&](const auto& texture_info, const glm::vec4& clear_color) -> std::shared_ptr<Texture> {
                         if(texture_info.texCoord != 0) {
                             std::cerr << "Unsupported texture coordinate channel (" << texture_info.texCoord << ")" << std::endl;
                             return nullptr;
                         }
 
-                        if(texture_info.index < 0) {
-                            return nullptr;
-                        }
-
-                        const int index = gltf.textures[texture_info.index].source;
+                        const int index = texture_image_index(gltf, texture_info);
                         if(index < 0) {
                             return nullptr;
                         }
 
                         auto& texture = textures[index];
-                        if(!texture) {
-                            if(const auto r = build_texture_data(gltf.images[index], as_sRGB); r.is_ok) {
-                                texture = std::make_shared<Texture>(r.value);
+                        if(!texture && images[index].is_ok) {
+                            if(settings.texture_uploader) {
+                                texture = settings.texture_uploader->upload(std::move(images[index].value), clear_color);
+                            } else {
+                                texture = std::make_shared<Texture>(images[index].value);
                             }
+                            images[index].value.data = nullptr;
                         }
                         return texture;
                     };
 
-                    auto albedo = load_texture(albedo_info, true);
-                    auto normal = load_texture(normal_info, false);
+                    auto albedo = load_texture(albedo_info, glm::vec4(1.0f));
+                    auto normal = load_texture(normal_info, glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
 
                     if(!albedo) {
                         mat = Material::empty_material();
@@ -409,15 +688,43 @@ Result<std::unique_ptr<Scene>> Scene::from_gltf(const std::string& file_name) {
                     }
                 }
 
-                material = mat;
+                material = scene->add_material(std::move(mat));
             }
 
-            auto scene_object = SceneObject(std::make_shared<StaticMesh>(mesh.value), std::move(material));
-            scene_object.set_transform(node_transform);
-            scene->add_object(std::move(scene_object));
+            const auto bounds = primitive_world_bounds(gltf, prim, node_transform);
+            const bool occluder = is_occluder(node, bounds, occluder_min_radius);
+
+            PositionQuantization quantization;
+            const bool quantize = position_quantization(gltf, prim, quantization);
+            auto static_mesh = std::make_shared<StaticMesh>(mesh.value, occluder, quantize ? &quantization : nullptr);
+
+            // The dequantization is folded into the object transform, through a child node so it is kept when the hierarchy moves
+            TransformHierarchy::NodeId object_node = node_id;
+            glm::mat4 object_transform = node_transform;
+            if(static_mesh->is_quantized()) {
+                Transform dequantization;
+                dequantization.translation = glm::vec3(quantization.offset);
+                dequantization.scale = glm::vec3(quantization.scale);
+                object_node = scene->transform_hierarchy().add_node(dequantization, node_id);
+                object_transform = node_transform * dequantization.to_matrix();
+
+                ++quantized_meshes;
+                quantized_bytes += static_mesh->vertex_byte_size();
+                unquantized_bytes += mesh.value.vertices.size() * sizeof(Vertex);
+            }
+
+            auto scene_object = SceneObject(scene->add_mesh(std::move(static_mesh)), material);
+            scene_object.set_transform(object_transform);
+            scene_object.set_occluder(occluder);
+            scene->add_object(std::move(scene_object), object_node);
         }
     }
 
+    if(quantized_meshes) {
+        std::cout << file_name << ": " << quantized_meshes << " quantized meshes, " << quantized_bytes / 1024 << "KB of vertices instead of "
+                  << unquantized_bytes / 1024 << "KB (" << (unquantized_bytes - quantized_bytes) / 1024 << "KB saved)" << std::endl;
+    }
+
     return {true, std::move(scene)};
 }
 
@@ -0,0 +1,126 @@
+#include "ShaderPreprocessor.h"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <cctype>
+
+namespace OM3D {
+
+static std::unordered_map<std::string, std::string> file_cache;
+
+static const std::string& read_shader_file(const std::string& file_name, std::string_view directive = {}) {
+    auto it = file_cache.find(file_name);
+    if(it == file_cache.end()) {
+        auto content = read_text_file(std::string(shader_path) + file_name);
+        if(!content.is_ok) {
+            if(directive.empty()) {
+                FATAL((std::string("Unable to read shader: \"") + std::string(shader_path) + file_name + '"').c_str());
+            }
+            FATAL((std::string("Shader include not found: \"") + std::string(directive) + '"').c_str());
+        }
+        it = file_cache.emplace(file_name, std::move(content.value)).first;
+    }
+    return it->second;
+}
+
+static std::string_view trim(std::string_view line) {
+    while(!line.empty() && std::isspace(line.front())) {
+        line = line.substr(1);
+    }
+    return line;
+}
+
+// Appends every line exactly once to the output, so the cost is linear in the final source size
+class Preprocessor : NonMovable {
+    public:
+        Preprocessor(Span<const std::string> defines) : _defines(defines) {
+        }
+
+        void append(const std::string& content) {
+            for(size_t i = 0; i < content.size();) {
+                size_t endl = content.find('\n', i);
+                if(endl == std::string::npos) {
+                    endl = content.size();
+                }
+
+                const std::string_view full_line = std::string_view(content).substr(i, endl - i);
+                i = endl + 1;
+
+                std::string_view line = trim(full_line);
+                if(!line.empty() && line.front() == '#') {
+                    line = trim(line.substr(1));
+                    if(line.substr(0, 7) == "include") {
+                        append_include(trim(line.substr(7)), full_line);
+                        continue;
+                    }
+
+                    append_line(full_line);
+                    if(line.substr(0, 7) == "version") {
+                        append_defines();
+                    }
+                    continue;
+                }
+
+                append_line(full_line);
+            }
+        }
+
+        std::string& output() {
+            return _output;
+        }
+
+    private:
+        void append_line(std::string_view line) {
+            _output += line;
+            _output += '\n';
+        }
+
+        void append_defines() {
+            if(_defines_added) {
+                return;
+            }
+            _defines_added = true;
+            for(const std::string& def : _defines) {
+                _output += "#define ";
+                _output += def;
+                _output += " 1\n";
+            }
+        }
+
+        void append_include(std::string_view include, std::string_view full_line) {
+            // TODO: parse <>
+            const auto end = include.empty() ? std::string_view::npos : include.find('"', 1);
+            if(include.empty() || include.front() != '"' || end != include.size() - 1) {
+                FATAL((std::string("Unable to parse shader include: \"") + std::string(full_line) + '"').c_str());
+            }
+
+            std::string include_file(include.substr(1, end - 1));
+            if(_includes.insert(include_file).second) {
+                append(read_shader_file(include_file, full_line));
+            }
+        }
+
+        Span<const std::string> _defines;
+        std::unordered_set<std::string> _includes;
+        std::string _output;
+        bool _defines_added = false;
+};
+
+PreprocessedShader preprocess_shader(const std::string& file_name, Span<const std::string> defines) {
+    const std::string& content = read_shader_file(file_name);
+
+    Preprocessor preprocessor(defines);
+    preprocessor.output().reserve(content.size() * 2);
+    preprocessor.append(content);
+
+    PreprocessedShader shader;
+    shader.source = std::move(preprocessor.output());
+    shader.hash = str_hash_64(shader.source);
+    return shader;
+}
+
+void clear_shader_cache() {
+    file_cache.clear();
+}
+
+}
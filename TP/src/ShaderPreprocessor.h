@@ -0,0 +1,26 @@
+#ifndef SHADERPREPROCESSOR_H
+#define SHADERPREPROCESSOR_H
+
+#include <graphics.h>
+
+#include <string>
+
+namespace OM3D {
+
+struct PreprocessedShader {
+    std::string source;
+
+    // Hash of the final source, stable across runs for a given (file, defines) permutation
+    u64 hash = 0;
+};
+
+// Resolves #include directives and injects defines after #version.
+// Included files are read from disk once and cached.
+PreprocessedShader preprocess_shader(const std::string& file_name, Span<const std::string> defines = {});
+
+// Drop cached file contents, to pick up modified shaders. Programs that are still alive are reused as is.
+void clear_shader_cache();
+
+}
+
+#endif // SHADERPREPROCESSOR_H
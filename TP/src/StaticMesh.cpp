@@ -4,13 +4,123 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
 namespace OM3D {
 
-StaticMesh::StaticMesh(const MeshData& data) :
-    _vertex_buffer(data.vertices),
-    _index_buffer(data.indices) {
+static std::vector<u32> concat_lods(const MeshData& data) {
+    if(data.lods.empty()) {
+        return data.indices;
+    }
+
+    std::vector<u32> indices = data.indices;
+    for(const auto& lod : data.lods) {
+        indices.insert(indices.end(), lod.begin(), lod.end());
+    }
+    return indices;
+}
 
-    if (_vertex_buffer.element_count() == 0)
+// Vertex layout of quantized meshes, 32 bytes instead of 60.
+// Positions are integers, everything else is normalized.
+struct QuantizedVertex {
+    i16 position[4]; // w is padding
+    i16 normal[4];
+    i16 tangent_bitangent_sign[4];
+    u16 uv[2];
+    u8 color[4];
+};
+
+static_assert(sizeof(QuantizedVertex) == 32);
+
+template<typename T>
+static T quantize_normalized(float x) {
+    const float max = float(std::numeric_limits<T>::max());
+    const float min = std::is_signed_v<T> ? -1.0f : 0.0f;
+    return T(std::round(std::clamp(x, min, 1.0f) * max));
+}
+
+// Empty if the vertices do not fit in the quantized layout
+static std::vector<QuantizedVertex> quantize_vertices(Span<const Vertex> vertices, const PositionQuantization& quantization) {
+    std::vector<QuantizedVertex> quantized(vertices.size());
+    for(size_t i = 0; i != vertices.size(); ++i) {
+        const Vertex& vert = vertices[i];
+        QuantizedVertex& q = quantized[i];
+
+        for(int c = 0; c != 3; ++c) {
+            const float position = std::round((vert.position[c] - quantization.offset) / quantization.scale);
+            if(!(position >= -32768.0f && position <= 32767.0f)) {
+                return {};
+            }
+            q.position[c] = i16(position);
+            q.normal[c] = quantize_normalized<i16>(vert.normal[c]);
+            q.color[c] = quantize_normalized<u8>(vert.color[c]);
+        }
+        for(int c = 0; c != 4; ++c) {
+            q.tangent_bitangent_sign[c] = quantize_normalized<i16>(vert.tangent_bitangent_sign[c]);
+        }
+        for(int c = 0; c != 2; ++c) {
+            // Tiling UVs would need their own scale
+            if(vert.uv[c] < 0.0f || vert.uv[c] > 1.0f) {
+                return {};
+            }
+            q.uv[c] = quantize_normalized<u16>(vert.uv[c]);
+        }
+        q.position[3] = 0;
+        q.normal[3] = 0;
+        q.color[3] = 255;
+    }
+    return quantized;
+}
+
+StaticMesh::StaticMesh(const MeshData& data, bool keep_occluder_mesh, const PositionQuantization* quantization) :
+    _index_buffer(concat_lods(data)) {
+
+    if(quantization) {
+        if(const auto quantized = quantize_vertices(data.vertices, *quantization); !quantized.empty()) {
+            _vertex_buffer = ByteBuffer(quantized.data(), quantized.size() * sizeof(QuantizedVertex));
+            _quantization = *quantization;
+            _quantized = true;
+
+            std::vector<std::array<i16, 4>> positions(quantized.size());
+            std::transform(quantized.begin(), quantized.end(), positions.begin(), [](const QuantizedVertex& vert) {
+                return std::array<i16, 4>{vert.position[0], vert.position[1], vert.position[2], vert.position[3]};
+            });
+            _position_buffer = ByteBuffer(positions.data(), positions.size() * sizeof(positions[0]));
+        }
+    }
+    if(!_quantized && !data.vertices.empty()) {
+        _vertex_buffer = ByteBuffer(data.vertices.data(), data.vertices.size() * sizeof(Vertex));
+
+        std::vector<glm::vec3> positions(data.vertices.size());
+        std::transform(data.vertices.begin(), data.vertices.end(), positions.begin(), [](const Vertex& vert) { return vert.position; });
+        _position_buffer = ByteBuffer(positions.data(), positions.size() * sizeof(glm::vec3));
+    }
+
+    // Mesh space to the space of the vertex buffer
+    const auto to_local = [&](const glm::vec3& position) {
+        return (position - _quantization.offset) / _quantization.scale;
+    };
+
+    _lods.push_back(IndexRange{0, u32(data.indices.size())});
+    for(const auto& lod : data.lods) {
+        _lods.push_back(IndexRange{_lods.back().first + _lods.back().count, u32(lod.size())});
+    }
+
+    if(keep_occluder_mesh) {
+        _occluder_mesh = std::make_unique<OccluderMesh>();
+        _occluder_mesh->positions.reserve(data.vertices.size());
+        for(const Vertex& vert : data.vertices) {
+            _occluder_mesh->positions.push_back(to_local(vert.position));
+        }
+        _occluder_mesh->indices = data.indices;
+    }
+
+    if (data.vertices.empty())
         return;
 
     const glm::vec3& first_pos = data.vertices[0].position;
@@ -50,6 +160,9 @@ StaticMesh::StaticMesh(const MeshData& data) :
     }
 
     _bounding_sphere.radius = max_dist;
+
+    _bounding_sphere.center = to_local(_bounding_sphere.center);
+    _bounding_sphere.radius /= _quantization.scale;
 }
 
 void StaticMesh::draw() const {
@@ -60,20 +173,51 @@ BoundingSphere StaticMesh::boundingSphere() const {
     return _bounding_sphere;
 }
 
-void StaticMesh::draw(int count) const {
+u32 StaticMesh::lod_count() const {
+    return u32(_lods.size());
+}
+
+const OccluderMesh* StaticMesh::occluder_mesh() const {
+    return _occluder_mesh.get();
+}
+
+bool StaticMesh::is_quantized() const {
+    return _quantized;
+}
+
+const PositionQuantization& StaticMesh::position_quantization() const {
+    return _quantization;
+}
+
+size_t StaticMesh::vertex_byte_size() const {
+    return _vertex_buffer.byte_size();
+}
+
+void StaticMesh::draw(int count, u32 lod) const {
+    DEBUG_ASSERT(lod < _lods.size());
+
     _vertex_buffer.bind(BufferUsage::Attribute);
     _index_buffer.bind(BufferUsage::Index);
 
-    // Vertex position
-    glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
-    // Vertex normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(3 * sizeof(float)));
-    // Vertex uv
-    glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(6 * sizeof(float)));
-    // Tangent / bitangent sign
-    glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(8 * sizeof(float)));
-    // Vertex color
-    glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(12 * sizeof(float)));
+    if(_quantized) {
+        const auto offset = [](size_t offset) { return reinterpret_cast<void*>(offset); };
+        glVertexAttribPointer(0, 3, GL_SHORT, false, sizeof(QuantizedVertex), offset(offsetof(QuantizedVertex, position)));
+        glVertexAttribPointer(1, 3, GL_SHORT, true, sizeof(QuantizedVertex), offset(offsetof(QuantizedVertex, normal)));
+        glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, true, sizeof(QuantizedVertex), offset(offsetof(QuantizedVertex, uv)));
+        glVertexAttribPointer(3, 4, GL_SHORT, true, sizeof(QuantizedVertex), offset(offsetof(QuantizedVertex, tangent_bitangent_sign)));
+        glVertexAttribPointer(4, 3, GL_UNSIGNED_BYTE, true, sizeof(QuantizedVertex), offset(offsetof(QuantizedVertex, color)));
+    } else {
+        // Vertex position
+        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(Vertex), nullptr);
+        // Vertex normal
+        glVertexAttribPointer(1, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(3 * sizeof(float)));
+        // Vertex uv
+        glVertexAttribPointer(2, 2, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(6 * sizeof(float)));
+        // Tangent / bitangent sign
+        glVertexAttribPointer(3, 4, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(8 * sizeof(float)));
+        // Vertex color
+        glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(Vertex), reinterpret_cast<void*>(12 * sizeof(float)));
+    }
 
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
@@ -81,7 +225,30 @@ void StaticMesh::draw(int count) const {
     glEnableVertexAttribArray(3);
     glEnableVertexAttribArray(4);
 
-    glDrawElementsInstanced(GL_TRIANGLES, int(_index_buffer.element_count()), GL_UNSIGNED_INT, nullptr, count);
+    const IndexRange& range = _lods[lod];
+    glDrawElementsInstanced(GL_TRIANGLES, int(range.count), GL_UNSIGNED_INT, reinterpret_cast<void*>(range.first * sizeof(u32)), count);
+}
+
+void StaticMesh::draw_positions(int count, u32 lod) const {
+    DEBUG_ASSERT(lod < _lods.size());
+
+    _position_buffer.bind(BufferUsage::Attribute);
+    _index_buffer.bind(BufferUsage::Index);
+
+    if(_quantized) {
+        glVertexAttribPointer(0, 3, GL_SHORT, false, 4 * sizeof(i16), nullptr);
+    } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, false, sizeof(glm::vec3), nullptr);
+    }
+
+    glEnableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glDisableVertexAttribArray(2);
+    glDisableVertexAttribArray(3);
+    glDisableVertexAttribArray(4);
+
+    const IndexRange& range = _lods[lod];
+    glDrawElementsInstanced(GL_TRIANGLES, int(range.count), GL_UNSIGNED_INT, reinterpret_cast<void*>(range.first * sizeof(u32)), count);
 }
 
 
@@ -6,12 +6,16 @@
 #include <Vertex.h>
 
 #include <vector>
+#include <memory>
 
 namespace OM3D {
 
 struct MeshData {
     std::vector<Vertex> vertices;
     std::vector<u32> indices;
+
+    // Simplified versions of indices, from the most to the least detailed
+    std::vector<std::vector<u32>> lods;
 };
 
 struct BoundingSphere {
@@ -19,6 +23,18 @@ struct BoundingSphere {
     float radius;
 };
 
+// CPU copy of the geometry used by the software occlusion rasterizer
+struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<u32> indices;
+};
+
+// Integer positions (KHR_mesh_quantization), mapped back to mesh space by position * scale + offset on every axis
+struct PositionQuantization {
+    float scale = 1.0f;
+    float offset = 0.0f;
+};
+
 class StaticMesh : NonCopyable {
 
     public:
@@ -26,17 +42,46 @@ class StaticMesh : NonCopyable {
         StaticMesh(StaticMesh&&) = default;
         StaticMesh& operator=(StaticMesh&&) = default;
 
-        StaticMesh(const MeshData& data);
+        // With a quantization, vertices are uploaded in a compact integer layout if they fit (UVs in [0, 1]).
+        StaticMesh(const MeshData& data, bool keep_occluder_mesh = false, const PositionQuantization* quantization = nullptr);
 
         void draw() const;
-        void draw(int count) const;
+        void draw(int count, u32 lod = 0) const;
+        // Only the position attribute, from a separate tightly packed stream (for depth only passes)
+        void draw_positions(int count, u32 lod = 0) const;
+
+        // Including the full detail mesh
+        u32 lod_count() const;
 
         BoundingSphere boundingSphere() const;
 
+        // nullptr if the mesh was not created with keep_occluder_mesh
+        const OccluderMesh* occluder_mesh() const;
+
+        // Quantized meshes (including their bounds and occluder mesh) are in the integer space,
+        // their objects have to apply position_quantization() before anything else.
+        bool is_quantized() const;
+        const PositionQuantization& position_quantization() const;
+
+        size_t vertex_byte_size() const;
+
     private:
-        TypedBuffer<Vertex> _vertex_buffer;
+        struct IndexRange {
+            u32 first;
+            u32 count;
+        };
+
+        ByteBuffer _vertex_buffer;
+        // Same positions as _vertex_buffer, in the same format
+        ByteBuffer _position_buffer;
+        // Every LOD in a single buffer
         TypedBuffer<u32> _index_buffer;
+        std::vector<IndexRange> _lods;
         BoundingSphere _bounding_sphere;
+        std::unique_ptr<OccluderMesh> _occluder_mesh;
+
+        bool _quantized = false;
+        PositionQuantization _quantization;
 };
 
 }
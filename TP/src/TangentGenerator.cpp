@@ -0,0 +1,197 @@
+#include "TangentGenerator.h"
+
+#include <ThreadPool.h>
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace OM3D {
+
+// Below this, splitting the triangles costs more than it saves
+static constexpr size_t min_triangles_per_chunk = 16 * 1024;
+static constexpr size_t vertices_per_merge_block = 16 * 1024;
+
+// Caps the number of chunks for big meshes, every chunk has a sum per vertex
+static constexpr size_t max_accumulation_bytes = 256 * 1024 * 1024;
+
+// w is unused
+struct TangentSums {
+    glm::vec4 tangent = glm::vec4(0.0f);
+    glm::vec4 bitangent = glm::vec4(0.0f);
+};
+
+#ifdef SIMD_SSE2
+static __m128 load_vec3(const float* data) {
+    const __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(data)));
+    return _mm_movelh_ps(xy, _mm_load_ss(data + 2));
+}
+
+// Result in every lane, w must be 0
+static __m128 dot3(__m128 a, __m128 b) {
+    const __m128 mul = _mm_mul_ps(a, b);
+    const __m128 sum = _mm_add_ps(mul, _mm_shuffle_ps(mul, mul, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+}
+
+static __m128 cross3(__m128 a, __m128 b) {
+    const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static void accumulate(TangentSums& sums, __m128 tangent, __m128 bitangent) {
+    _mm_storeu_ps(&sums.tangent.x, _mm_add_ps(_mm_loadu_ps(&sums.tangent.x), tangent));
+    _mm_storeu_ps(&sums.bitangent.x, _mm_add_ps(_mm_loadu_ps(&sums.bitangent.x), bitangent));
+}
+#endif
+
+static void accumulate_triangles(Span<const Vertex> vertices, Span<const u32> indices, size_t begin, size_t end, TangentSums* sums) {
+    for(size_t i = begin; i != end; i += 3) {
+        const u32 tri[] = {indices[i + 0], indices[i + 1], indices[i + 2]};
+
+        const glm::vec2 uv_edges[] = {
+            vertices[tri[1]].uv - vertices[tri[0]].uv,
+            vertices[tri[2]].uv - vertices[tri[0]].uv,
+        };
+
+        const float det = uv_edges[0].x * uv_edges[1].y - uv_edges[1].x * uv_edges[0].y;
+        if(!(std::abs(det) > 0.0f)) {
+            continue;
+        }
+
+        // Dividing by det would give the actual derivatives, using its sign only
+        // keeps the directions without blowing up on tiny UV triangles
+        const float s = det < 0.0f ? -1.0f : 1.0f;
+
+#ifdef SIMD_SSE2
+        const __m128 p0 = load_vec3(&vertices[tri[0]].position.x);
+        const __m128 e0 = _mm_sub_ps(load_vec3(&vertices[tri[1]].position.x), p0);
+        const __m128 e1 = _mm_sub_ps(load_vec3(&vertices[tri[2]].position.x), p0);
+
+        const __m128 tangent = _mm_sub_ps(
+            _mm_mul_ps(e0, _mm_set1_ps(uv_edges[1].y * s)),
+            _mm_mul_ps(e1, _mm_set1_ps(uv_edges[0].y * s)));
+        const __m128 bitangent = _mm_sub_ps(
+            _mm_mul_ps(e1, _mm_set1_ps(uv_edges[0].x * s)),
+            _mm_mul_ps(e0, _mm_set1_ps(uv_edges[1].x * s)));
+
+        for(const u32 index : tri) {
+            accumulate(sums[index], tangent, bitangent);
+        }
+#else
+        const glm::vec3 e0 = vertices[tri[1]].position - vertices[tri[0]].position;
+        const glm::vec3 e1 = vertices[tri[2]].position - vertices[tri[0]].position;
+
+        const glm::vec4 tangent = glm::vec4((e0 * uv_edges[1].y - e1 * uv_edges[0].y) * s, 0.0f);
+        const glm::vec4 bitangent = glm::vec4((e1 * uv_edges[0].x - e0 * uv_edges[1].x) * s, 0.0f);
+
+        for(const u32 index : tri) {
+            sums[index].tangent += tangent;
+            sums[index].bitangent += bitangent;
+        }
+#endif
+    }
+}
+
+// For vertices without usable UVs: anything orthogonal to the normal
+static glm::vec4 fallback_tangent(const glm::vec3& normal) {
+    const glm::vec3 axis = std::abs(normal.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 tangent = glm::cross(normal, axis);
+    const float length = glm::length(tangent);
+    return glm::vec4(length > 0.0f ? tangent / length : axis, 1.0f);
+}
+
+static void finalize_tangent(Vertex& vertex, const TangentSums& sums) {
+#ifdef SIMD_SSE2
+    const __m128 normal = load_vec3(&vertex.normal.x);
+    const __m128 bitangent = _mm_loadu_ps(&sums.bitangent.x);
+
+    // Gram-Schmidt
+    __m128 tangent = _mm_loadu_ps(&sums.tangent.x);
+    tangent = _mm_sub_ps(tangent, _mm_mul_ps(normal, dot3(normal, tangent)));
+
+    const float length = std::sqrt(_mm_cvtss_f32(dot3(tangent, tangent)));
+    if(!(length > 1e-20f)) {
+        vertex.tangent_bitangent_sign = fallback_tangent(vertex.normal);
+        return;
+    }
+    tangent = _mm_div_ps(tangent, _mm_set1_ps(length));
+
+    // bitangent points toward increasing v, the glTF bitangent the other way
+    const float sign = _mm_cvtss_f32(dot3(cross3(normal, tangent), bitangent)) < 0.0f ? 1.0f : -1.0f;
+    _mm_storeu_ps(&vertex.tangent_bitangent_sign.x, tangent);
+    vertex.tangent_bitangent_sign.w = sign;
+#else
+    const glm::vec3 normal = vertex.normal;
+    const glm::vec3 bitangent = sums.bitangent;
+
+    // Gram-Schmidt
+    glm::vec3 tangent = sums.tangent;
+    tangent -= normal * glm::dot(normal, tangent);
+
+    const float length = glm::length(tangent);
+    if(!(length > 1e-20f)) {
+        vertex.tangent_bitangent_sign = fallback_tangent(vertex.normal);
+        return;
+    }
+    tangent /= length;
+
+    // bitangent points toward increasing v, the glTF bitangent the other way
+    const float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? 1.0f : -1.0f;
+    vertex.tangent_bitangent_sign = glm::vec4(tangent, sign);
+#endif
+}
+
+void generate_tangents(Span<Vertex> vertices, Span<const u32> indices) {
+    const size_t vertex_count = vertices.size();
+    const size_t triangle_count = indices.size() / 3;
+    if(!vertex_count) {
+        return;
+    }
+
+    ThreadPool& pool = ThreadPool::global();
+
+    const size_t max_chunks = std::max(size_t(1), max_accumulation_bytes / (vertex_count * sizeof(TangentSums)));
+    const size_t chunk_count = std::max(size_t(1), std::min({
+        size_t(pool.thread_count()) + 1,
+        triangle_count / min_triangles_per_chunk,
+        max_chunks
+    }));
+    const size_t triangles_per_chunk = (triangle_count + chunk_count - 1) / chunk_count;
+
+    // Every chunk sums into its own buffer, so no synchronisation is needed
+    std::vector<std::vector<TangentSums>> chunk_sums(chunk_count);
+    pool.parallel_for(chunk_count, [&](size_t chunk) {
+        const size_t begin = std::min(chunk * triangles_per_chunk, triangle_count) * 3;
+        const size_t end = std::min((chunk + 1) * triangles_per_chunk, triangle_count) * 3;
+
+        chunk_sums[chunk].resize(vertex_count);
+        accumulate_triangles(vertices, indices, begin, end, chunk_sums[chunk].data());
+    });
+
+    // Merge the chunks and finalize, over independent vertex ranges
+    const size_t block_count = (vertex_count + vertices_per_merge_block - 1) / vertices_per_merge_block;
+    pool.parallel_for(block_count, [&](size_t block) {
+        const size_t begin = block * vertices_per_merge_block;
+        const size_t end = std::min(begin + vertices_per_merge_block, vertex_count);
+
+        for(size_t i = begin; i != end; ++i) {
+            TangentSums sums = chunk_sums[0][i];
+            for(size_t c = 1; c != chunk_count; ++c) {
+                sums.tangent += chunk_sums[c][i].tangent;
+                sums.bitangent += chunk_sums[c][i].bitangent;
+            }
+            finalize_tangent(vertices[i], sums);
+        }
+    });
+}
+
+}
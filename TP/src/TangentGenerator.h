@@ -0,0 +1,17 @@
+#ifndef TANGENTGENERATOR_H
+#define TANGENTGENERATOR_H
+
+#include <Vertex.h>
+#include <utils.h>
+
+namespace OM3D {
+
+// Per vertex tangents from positions and UVs, following the glTF convention:
+// xyz points toward increasing u (orthogonalized against the normal), w is the bitangent sign
+// so that cross(normal, tangent.xyz) * w points toward decreasing v (up in the image, glTF UVs start at the top left).
+// Triangles are processed in parallel, normals must already be set.
+void generate_tangents(Span<Vertex> vertices, Span<const u32> indices);
+
+}
+
+#endif // TANGENTGENERATOR_H
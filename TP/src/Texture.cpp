@@ -5,32 +5,147 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb/stb_image.h>
 
+#include <glm/common.hpp>
+
 #include <cmath>
 #include <algorithm>
+#include <array>
 
 namespace OM3D {
 
-Result<TextureData> TextureData::from_file(const std::string& file) {
-    int width = 0;
-    int height = 0;
-    int channels = 0;
-    u8* img = stbi_load(file.c_str(), &width, &height, &channels, 4);
-    DEFER(stbi_image_free(img));
+void TextureData::Deleter::operator()(u8* ptr) const {
+    stbi_image_free(ptr);
+}
+
+TextureData::Pixels TextureData::allocate(size_t bytes) {
+    return Pixels(static_cast<u8*>(STBI_MALLOC(bytes)));
+}
+
+glm::uvec2 TextureData::mip_size(u32 mip) const {
+    return glm::max(glm::uvec2(1), size >> mip);
+}
+
+size_t TextureData::mip_byte_size(u32 mip) const {
+    const glm::uvec2 level_size = mip_size(mip);
+    return size_t(level_size.x) * level_size.y * bytes_per_pixel(format);
+}
+
+u8* TextureData::mip_data(u32 mip) const {
+    DEBUG_ASSERT(mip < mip_count);
+    size_t offset = 0;
+    for(u32 i = 0; i != mip; ++i) {
+        offset += mip_byte_size(i);
+    }
+    return data.get() + offset;
+}
+
+static float srgb_to_linear(u8 value) {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> t = {};
+        for(u32 i = 0; i != 256; ++i) {
+            const float c = float(i) / 255.0f;
+            t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return t;
+    }();
+    return table[value];
+}
+
+static u8 linear_to_srgb(float value) {
+    static constexpr u32 table_size = 16384;
+    static const std::vector<u8> table = [] {
+        std::vector<u8> t(table_size);
+        for(u32 i = 0; i != table_size; ++i) {
+            const float c = float(i) / float(table_size - 1);
+            const float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+            t[i] = u8(std::round(std::clamp(s, 0.0f, 1.0f) * 255.0f));
+        }
+        return t;
+    }();
+    return table[u32(std::clamp(value, 0.0f, 1.0f) * float(table_size - 1) + 0.5f)];
+}
+
+// 2x2 box filter, the last row and column are repeated for odd sizes
+static void downsample_rgba8(const u8* src, glm::uvec2 src_size, u8* dst, glm::uvec2 dst_size, bool srgb) {
+    for(u32 y = 0; y != dst_size.y; ++y) {
+        const u32 rows[] = {std::min(2 * y, src_size.y - 1), std::min(2 * y + 1, src_size.y - 1)};
+        for(u32 x = 0; x != dst_size.x; ++x) {
+            const u32 cols[] = {std::min(2 * x, src_size.x - 1), std::min(2 * x + 1, src_size.x - 1)};
+
+            float sum[4] = {};
+            for(const u32 row : rows) {
+                for(const u32 col : cols) {
+                    const u8* texel = src + (size_t(row) * src_size.x + col) * 4;
+                    for(u32 c = 0; c != 3; ++c) {
+                        sum[c] += srgb ? srgb_to_linear(texel[c]) : float(texel[c]);
+                    }
+                    sum[3] += float(texel[3]);
+                }
+            }
+
+            u8* out = dst + (size_t(y) * dst_size.x + x) * 4;
+            for(u32 c = 0; c != 3; ++c) {
+                out[c] = srgb ? linear_to_srgb(sum[c] * 0.25f) : u8(sum[c] * 0.25f + 0.5f);
+            }
+            out[3] = u8(sum[3] * 0.25f + 0.5f);
+        }
+    }
+}
+
+void TextureData::generate_mips() {
+    ALWAYS_ASSERT(format == ImageFormat::RGBA8_UNORM || format == ImageFormat::RGBA8_sRGB, "Unsupported format for mip generation");
+
+    const u32 level_count = Texture::mip_levels(size);
+    if(mip_count == level_count) {
+        return;
+    }
+
+    size_t total_size = 0;
+    for(u32 i = 0; i != level_count; ++i) {
+        total_size += mip_byte_size(i);
+    }
+
+    Pixels levels = allocate(total_size);
+    std::copy_n(data.get(), mip_byte_size(0), levels.get());
+    data = std::move(levels);
+    mip_count = level_count;
+
+    const bool srgb = format == ImageFormat::RGBA8_sRGB;
+    for(u32 i = 1; i != mip_count; ++i) {
+        downsample_rgba8(mip_data(i - 1), mip_size(i - 1), mip_data(i), mip_size(i), srgb);
+    }
+}
+
+static Result<TextureData> create_texture_data(u8* img, int width, int height, int channels, ImageFormat format) {
+    TextureData::Pixels pixels(img);
     if(!img || width <= 0 || height <= 0 || channels <= 0) {
         return {false, {}};
     }
 
-    const size_t bytes = width * height * 4;
-
     TextureData data;
     data.size = glm::uvec2(width, height);
-    data.format = ImageFormat::RGBA8_UNORM;
-    data.data = std::make_unique<u8[]>(bytes);
-    std::copy_n(img, bytes, data.data.get());
+    data.format = format;
+    data.data = std::move(pixels);
 
     return {true, std::move(data)};
 }
 
+Result<TextureData> TextureData::from_file(const std::string& file) {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    u8* img = stbi_load(file.c_str(), &width, &height, &channels, 4);
+    return create_texture_data(img, width, height, channels, ImageFormat::RGBA8_UNORM);
+}
+
+Result<TextureData> TextureData::from_memory(Span<const u8> encoded, bool as_sRGB) {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    u8* img = stbi_load_from_memory(encoded.data(), int(encoded.size()), &width, &height, &channels, 4);
+    return create_texture_data(img, width, height, channels, as_sRGB ? ImageFormat::RGBA8_sRGB : ImageFormat::RGBA8_UNORM);
+}
+
 
 
 static GLuint create_texture_handle() {
@@ -46,17 +161,21 @@ Texture::Texture(const TextureData& data) :
 
     const ImageFormatGL gl_format = image_format_to_gl(_format);
     glTextureStorage2D(_handle.get(), mip_levels(_size), gl_format.internal_format, _size.x, _size.y);
-    glTextureSubImage2D(_handle.get(), 0, 0, 0, _size.x, _size.y, gl_format.format, gl_format.component_type, data.data.get());
-    glGenerateTextureMipmap(_handle.get());
+    for(u32 i = 0; i != data.mip_count; ++i) {
+        upload(i, 0, data.mip_size(i).y, data.mip_data(i));
+    }
+    if(data.mip_count == 1) {
+        generate_mipmaps();
+    }
 }
 
-Texture::Texture(const glm::uvec2 &size, ImageFormat format) :
+Texture::Texture(const glm::uvec2 &size, ImageFormat format, u32 mips) :
     _handle(create_texture_handle()),
     _size(size),
     _format(format) {
 
     const ImageFormatGL gl_format = image_format_to_gl(_format);
-    glTextureStorage2D(_handle.get(), 1, gl_format.internal_format, _size.x, _size.y);
+    glTextureStorage2D(_handle.get(), mips, gl_format.internal_format, _size.x, _size.y);
 }
 
 Texture::~Texture() {
@@ -69,14 +188,53 @@ void Texture::bind(u32 index) const {
     glBindTextureUnit(index, _handle.get());
 }
 
-void Texture::bind_as_image(u32 index, AccessType access) {
-    glBindImageTexture(index, _handle.get(), 0, false, 0, access_type_to_gl(access), image_format_to_gl(_format).internal_format);
+void Texture::bind_as_image(u32 index, AccessType access, u32 mip) {
+    glBindImageTexture(index, _handle.get(), mip, false, 0, access_type_to_gl(access), image_format_to_gl(_format).internal_format);
+}
+
+void Texture::read_back(u32 mip, void* data, size_t byte_size) const {
+    const ImageFormatGL gl_format = image_format_to_gl(_format);
+    glGetTextureImage(_handle.get(), mip, gl_format.format, gl_format.component_type, GLsizei(byte_size), data);
+}
+
+void Texture::upload(u32 mip, u32 first_row, u32 row_count, const void* data) {
+    const ImageFormatGL gl_format = image_format_to_gl(_format);
+    const glm::uvec2 size = mip_size(mip);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(_handle.get(), mip, 0, first_row, size.x, row_count, gl_format.format, gl_format.component_type, data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void Texture::clear(const glm::vec4& color) {
+    GLint mips = 0;
+    glGetTextureParameteriv(_handle.get(), GL_TEXTURE_IMMUTABLE_LEVELS, &mips);
+    for(GLint i = 0; i != mips; ++i) {
+        glClearTexImage(_handle.get(), i, GL_RGBA, GL_FLOAT, &color);
+    }
+}
+
+void Texture::copy_to(Texture& dst, const glm::uvec2& size) const {
+    DEBUG_ASSERT(dst._format == _format);
+    DEBUG_ASSERT(size.x <= std::min(_size.x, dst._size.x) && size.y <= std::min(_size.y, dst._size.y));
+    glCopyImageSubData(_handle.get(), GL_TEXTURE_2D, 0, 0, 0, 0, dst._handle.get(), GL_TEXTURE_2D, 0, 0, 0, 0, size.x, size.y, 1);
+}
+
+void Texture::generate_mipmaps() {
+    glGenerateTextureMipmap(_handle.get());
 }
 
 const glm::uvec2& Texture::size() const {
     return _size;
 }
 
+ImageFormat Texture::format() const {
+    return _format;
+}
+
+glm::uvec2 Texture::mip_size(u32 mip) const {
+    return glm::max(glm::uvec2(1), _size >> mip);
+}
+
 // Return number of mip levels needed
 u32 Texture::mip_levels(glm::uvec2 size) {
     const float side = float(std::max(size.x, size.y));
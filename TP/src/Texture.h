@@ -5,6 +5,7 @@
 #include <ImageFormat.h>
 
 #include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
 
 #include <vector>
 #include <memory>
@@ -13,11 +14,31 @@
 namespace OM3D {
 
 struct TextureData {
-    std::unique_ptr<u8[]> data;
+    // Pixels are allocated like stb_image does, so decoded images are moved in without a copy
+    struct Deleter {
+        void operator()(u8* ptr) const;
+    };
+    using Pixels = std::unique_ptr<u8[], Deleter>;
+
+    // Mip levels are stored one after the other, starting with the full size one
+    Pixels data;
     glm::uvec2 size = {};
     ImageFormat format;
+    u32 mip_count = 1;
+
+    glm::uvec2 mip_size(u32 mip) const;
+    size_t mip_byte_size(u32 mip) const;
+    u8* mip_data(u32 mip) const;
+
+    // Replaces the pixels by the full mip chain, RGBA8 formats only. sRGB levels are filtered in linear space.
+    // Can be called from any thread.
+    void generate_mips();
+
+    static Pixels allocate(size_t bytes);
 
     static Result<TextureData> from_file(const std::string& file_name);
+    // Decodes an encoded image (PNG, JPEG...) to RGBA8, can be called from any thread
+    static Result<TextureData> from_memory(Span<const u8> encoded, bool as_sRGB);
 };
 
 class Texture {
@@ -30,12 +51,24 @@ class Texture {
         ~Texture();
 
         Texture(const TextureData& data);
-        Texture(const glm::uvec2 &size, ImageFormat format);
+        Texture(const glm::uvec2 &size, ImageFormat format, u32 mips = 1);
 
         void bind(u32 index) const;
-        void bind_as_image(u32 index, AccessType access);
+        void bind_as_image(u32 index, AccessType access, u32 mip = 0);
+
+        // If a pixel pack buffer is bound, data is an offset into it
+        void read_back(u32 mip, void* data, size_t byte_size) const;
+        // If a pixel unpack buffer is bound, data is an offset into it
+        void upload(u32 mip, u32 first_row, u32 row_count, const void* data);
+        void clear(const glm::vec4& color);
+        // Copies the size.x * size.y first texels of the first level, both textures must have the same format
+        void copy_to(Texture& dst, const glm::uvec2& size) const;
+        // Fills every level after the first one from it
+        void generate_mipmaps();
 
         const glm::uvec2& size() const;
+        ImageFormat format() const;
+        glm::uvec2 mip_size(u32 mip) const;
 
         static u32 mip_levels(glm::uvec2 size);
 
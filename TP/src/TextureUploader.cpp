@@ -0,0 +1,134 @@
+#include "TextureUploader.h"
+
+#include <glad/glad.h>
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace OM3D {
+
+TextureUploader::TextureUploader(size_t frame_budget) : _frame_budget(frame_budget) {
+    const size_t byte_size = _frame_budget * frames_in_flight;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    GLuint handle = 0;
+    glCreateBuffers(1, &handle);
+    glNamedBufferStorage(handle, byte_size, nullptr, flags);
+    _mapping = static_cast<byte*>(glMapNamedBufferRange(handle, 0, byte_size, flags));
+    _buffer = GLHandle(handle);
+}
+
+TextureUploader::~TextureUploader() {
+    // Workers still write into the pending uploads
+    for(const auto& upload : _uploads) {
+        if(upload->mips.valid()) {
+            upload->mips.wait();
+        }
+    }
+
+    for(void* fence : _fences) {
+        if(fence) {
+            glDeleteSync(static_cast<GLsync>(fence));
+        }
+    }
+
+    if(auto handle = _buffer.get()) {
+        glUnmapNamedBuffer(handle);
+        glDeleteBuffers(1, &handle);
+    }
+}
+
+std::shared_ptr<Texture> TextureUploader::upload(TextureData data, const glm::vec4& clear_color) {
+    ALWAYS_ASSERT(data.size.x * bytes_per_pixel(data.format) <= _frame_budget, "Texture rows do not fit in the upload budget");
+
+    auto texture = std::make_shared<Texture>(data.size, data.format, Texture::mip_levels(data.size));
+    texture->clear(clear_color);
+
+    auto upload = std::make_unique<Upload>();
+    upload->texture = texture;
+    upload->data = std::move(data);
+
+    const ImageFormat format = upload->data.format;
+    if(upload->data.mip_count == 1 && (format == ImageFormat::RGBA8_UNORM || format == ImageFormat::RGBA8_sRGB)) {
+        Upload* ptr = upload.get();
+        upload->mips = ThreadPool::background().schedule([ptr] { ptr->data.generate_mips(); });
+    }
+
+    _uploads.emplace_back(std::move(upload));
+    return texture;
+}
+
+void TextureUploader::update() {
+    _last_frame_bytes = 0;
+
+    // The segment is still read by the GPU, try again next frame
+    const u32 segment = _frame % frames_in_flight;
+    if(void*& fence = _fences[segment]) {
+        if(glClientWaitSync(static_cast<GLsync>(fence), 0, 0) == GL_TIMEOUT_EXPIRED) {
+            return;
+        }
+        glDeleteSync(static_cast<GLsync>(fence));
+        fence = nullptr;
+    }
+
+    const size_t segment_begin = segment * _frame_budget;
+    size_t offset = 0;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer.get());
+
+    // Uploads are done in order, so textures appear in the order they were requested
+    while(!_uploads.empty()) {
+        Upload& upload = *_uploads.front();
+        if(upload.mips.valid()) {
+            if(upload.mips.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                break;
+            }
+            upload.mips.get();
+        }
+
+        const TextureData& data = upload.data;
+        const glm::uvec2 size = data.mip_size(upload.mip);
+        const size_t row_bytes = size_t(size.x) * bytes_per_pixel(data.format);
+        const u32 rows = u32(std::min(size_t(size.y - upload.row), (_frame_budget - offset) / row_bytes));
+        if(!rows) {
+            break;
+        }
+
+        const size_t bytes = rows * row_bytes;
+        std::memcpy(_mapping + segment_begin + offset, data.mip_data(upload.mip) + upload.row * row_bytes, bytes);
+        upload.texture->upload(upload.mip, upload.row, rows, reinterpret_cast<const void*>(segment_begin + offset));
+        offset += bytes;
+
+        upload.row += rows;
+        if(upload.row == size.y) {
+            upload.row = 0;
+            if(++upload.mip == data.mip_count) {
+                if(data.mip_count == 1) {
+                    upload.texture->generate_mipmaps();
+                }
+                _uploads.pop_front();
+            }
+        }
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if(offset) {
+        _fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    _last_frame_bytes = offset;
+    ++_frame;
+}
+
+u32 TextureUploader::pending_count() const {
+    return u32(_uploads.size());
+}
+
+size_t TextureUploader::last_frame_bytes() const {
+    return _last_frame_bytes;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef TEXTUREUPLOADER_H
+#define TEXTUREUPLOADER_H
+
+#include <Texture.h>
+
+#include <array>
+#include <deque>
+#include <future>
+
+namespace OM3D {
+
+// Streams textures to the GPU over several frames.
+// Mip chains are generated on the thread pool, then copied through a persistently mapped
+// pixel unpack buffer, split in one segment per frame in flight and guarded by fences.
+class TextureUploader : NonMovable {
+    public:
+        static constexpr u32 frames_in_flight = 3;
+
+        TextureUploader(size_t frame_budget = 8 * 1024 * 1024);
+        ~TextureUploader();
+
+        // Returns immediately, the texture is cleared to clear_color until all of it has been uploaded
+        std::shared_ptr<Texture> upload(TextureData data, const glm::vec4& clear_color = glm::vec4(1.0f));
+
+        // Uploads at most frame_budget bytes, call once per frame
+        void update();
+
+        u32 pending_count() const;
+        size_t last_frame_bytes() const;
+
+    private:
+        struct Upload {
+            std::shared_ptr<Texture> texture;
+            TextureData data;
+            std::future<void> mips;
+
+            // Next rows to upload
+            u32 mip = 0;
+            u32 row = 0;
+        };
+
+        std::deque<std::unique_ptr<Upload>> _uploads;
+
+        GLHandle _buffer;
+        byte* _mapping = nullptr;
+        size_t _frame_budget = 0;
+
+        std::array<void*, frames_in_flight> _fences = {};
+        u32 _frame = 0;
+        size_t _last_frame_bytes = 0;
+};
+
+}
+
+#endif // TEXTUREUPLOADER_H
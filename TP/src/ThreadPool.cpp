@@ -0,0 +1,126 @@
+#include "ThreadPool.h"
+
+#include "AllocationTracker.h"
+
+namespace OM3D {
+
+ThreadPool::ThreadPool(u32 thread_count) {
+    for(u32 i = 0; i != thread_count; ++i) {
+        _threads.emplace_back([this] { run(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        const std::unique_lock lock(_lock);
+        _stop = true;
+    }
+    _condition.notify_all();
+    for(std::thread& thread : _threads) {
+        thread.join();
+    }
+}
+
+u32 ThreadPool::thread_count() const {
+    return u32(_threads.size());
+}
+
+std::future<void> ThreadPool::schedule(std::function<void()> func) {
+    std::packaged_task<void()> task(std::move(func));
+    auto future = task.get_future();
+    {
+        const std::unique_lock lock(_lock);
+        _tasks.emplace_back(std::move(task));
+    }
+    _condition.notify_one();
+    return future;
+}
+
+void ThreadPool::parallel_for(size_t count, const void* func, JobFunc call) {
+    if(count <= 1 || _threads.empty()) {
+        for(size_t i = 0; i != count; ++i) {
+            call(func, i);
+        }
+        return;
+    }
+
+    ParallelJob job;
+    job.func = func;
+    job.call = call;
+    job.count = count;
+    job.allocation_scope = current_allocation_scope();
+    {
+        const std::unique_lock lock(_lock);
+        job.next_job = _jobs;
+        _jobs = &job;
+    }
+    _condition.notify_all();
+
+    process(job);
+
+    // Every index is taken: only wait for the threads still running one
+    std::unique_lock lock(_lock);
+    unlink_job(&job);
+    _job_done.wait(lock, [&] { return job.helpers == 0; });
+}
+
+void ThreadPool::unlink_job(ParallelJob* job) {
+    for(ParallelJob** it = &_jobs; *it; it = &(*it)->next_job) {
+        if(*it == job) {
+            *it = job->next_job;
+            return;
+        }
+    }
+}
+
+void ThreadPool::process(ParallelJob& job) {
+    for(size_t i = job.next++; i < job.count; i = job.next++) {
+        job.call(job.func, i);
+    }
+}
+
+void ThreadPool::run() {
+    std::unique_lock lock(_lock);
+    for(;;) {
+        _condition.wait(lock, [&] { return _stop || _jobs || !_tasks.empty(); });
+
+        if(ParallelJob* job = _jobs) {
+            ++job->helpers;
+            lock.unlock();
+            {
+                const AllocationScope scope(job->allocation_scope);
+                process(*job);
+            }
+            lock.lock();
+
+            // Exhausted, so no other thread joins it
+            unlink_job(job);
+            if(--job->helpers == 0) {
+                _job_done.notify_all();
+            }
+            continue;
+        }
+
+        if(_tasks.empty()) {
+            return;
+        }
+
+        std::packaged_task<void()> task = std::move(_tasks.front());
+        _tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+ThreadPool& ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool& ThreadPool::background() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency() / 2));
+    return pool;
+}
+
+}
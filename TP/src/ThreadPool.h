@@ -0,0 +1,74 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <utils.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+#include <deque>
+
+namespace OM3D {
+
+class ThreadPool : NonMovable {
+    public:
+        ThreadPool(u32 thread_count = std::max(1u, std::thread::hardware_concurrency()));
+        ~ThreadPool();
+
+        u32 thread_count() const;
+
+        std::future<void> schedule(std::function<void()> func);
+
+        // Calls func(i) for every i in [0; count), the calling thread takes part in the work.
+        // Idle pool threads join in, busy ones are not waited for, and nothing is allocated.
+        // Should not be called from a pool thread.
+        template<typename F>
+        void parallel_for(size_t count, const F& func) {
+            parallel_for(count, &func, [](const void* f, size_t i) { (*static_cast<const F*>(f))(i); });
+        }
+
+        static ThreadPool& global();
+        // For long tasks that are not waited on by a frame (texture mips), so they never keep global() busy
+        static ThreadPool& background();
+
+    private:
+        using JobFunc = void (*)(const void*, size_t);
+
+        // Lives on the stack of the parallel_for caller
+        struct ParallelJob {
+            const void* func = nullptr;
+            JobFunc call = nullptr;
+            size_t count = 0;
+            std::atomic<size_t> next = 0;
+            // Allocation scope of the caller, entered by the helping threads
+            u32 allocation_scope = 0;
+
+            // Guarded by _lock
+            u32 helpers = 0;
+            ParallelJob* next_job = nullptr;
+        };
+
+        void parallel_for(size_t count, const void* func, JobFunc call);
+        void unlink_job(ParallelJob* job);
+        static void process(ParallelJob& job);
+
+        void run();
+
+        std::vector<std::thread> _threads;
+
+        std::mutex _lock;
+        std::condition_variable _condition;
+        std::deque<std::packaged_task<void()>> _tasks;
+        bool _stop = false;
+
+        // Jobs pool threads can help with, taken before scheduled tasks
+        ParallelJob* _jobs = nullptr;
+        std::condition_variable _job_done;
+};
+
+}
+
+#endif // THREADPOOL_H
@@ -0,0 +1,75 @@
+#include "Tonemapper.h"
+
+#include <glad/glad.h>
+
+namespace OM3D {
+
+static constexpr u32 histogram_group_size = 16;
+
+static u32 group_count(u32 size) {
+    return align_up_to(size, histogram_group_size) / histogram_group_size;
+}
+
+Tonemapper::Tonemapper() :
+        _histogram_program(Program::from_file("exposure_histogram.comp")),
+        _exposure_program(Program::from_file("exposure.comp")) {
+
+    _tonemap_material.set_program(Program::from_files("tonemap.frag", "screen.vert"));
+    _tonemap_material.set_depth_test_mode(DepthTestMode::None);
+    _tonemap_material.set_write_depth(false);
+
+    shader::ExposureData data = {};
+    data.exposure = 1.0f;
+    _exposure_buffer = TypedBuffer<shader::ExposureData>(&data, 1);
+}
+
+ExposureSettings& Tonemapper::settings() {
+    return _settings;
+}
+
+void Tonemapper::update_exposure(const Texture& hdr, const glm::uvec2& size, float delta_time) {
+    const float log_range = std::max(0.01f, _settings.max_log_luminance - _settings.min_log_luminance);
+
+    _exposure_buffer.bind(BufferUsage::Storage, 3);
+
+    hdr.bind(0);
+    _histogram_program->bind();
+    _histogram_program->set_uniform(HASH("size"), size);
+    _histogram_program->set_uniform(HASH("min_log_luminance"), _settings.min_log_luminance);
+    _histogram_program->set_uniform(HASH("log_luminance_range"), log_range);
+    glDispatchCompute(group_count(size.x), group_count(size.y), 1);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    _exposure_program->bind();
+    _exposure_program->set_uniform(HASH("min_log_luminance"), _settings.min_log_luminance);
+    _exposure_program->set_uniform(HASH("log_luminance_range"), log_range);
+    _exposure_program->set_uniform(HASH("pixel_count"), float(size.x * size.y));
+    _exposure_program->set_uniform(HASH("delta_time"), delta_time);
+    _exposure_program->set_uniform(HASH("adaptation_speed"), _settings.adaptation_speed);
+    _exposure_program->set_uniform(HASH("key_value"), _settings.key_value);
+    glDispatchCompute(1, 1, 1);
+
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void Tonemapper::render(const Texture& hdr, const Viewport& viewport, float delta_time, bool debug_view) {
+    const bool auto_exposure = _settings.auto_exposure && !debug_view;
+    if(auto_exposure) {
+        update_exposure(hdr, viewport.size, delta_time);
+    }
+
+    _exposure_buffer.bind(BufferUsage::Storage, 3);
+
+    _tonemap_material.set_uniform(HASH("exposure"), _settings.exposure);
+    _tonemap_material.set_uniform(HASH("auto_exposure"), u32(auto_exposure));
+    _tonemap_material.set_uniform(HASH("apply_tonemap"), u32(!debug_view));
+    _tonemap_material.set_uniform(HASH("uv_scale"), viewport.uv_scale());
+    _tonemap_material.set_uniform(HASH("render_size"), viewport.size);
+    _tonemap_material.bind();
+    hdr.bind(0);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef TONEMAPPER_H
+#define TONEMAPPER_H
+
+#include <Material.h>
+#include <TypedBuffer.h>
+#include <Framebuffer.h>
+
+#include <shader_structs.h>
+
+namespace OM3D {
+
+struct ExposureSettings {
+    bool auto_exposure = true;
+
+    // Manual exposure, or compensation applied on top of the auto exposure
+    float exposure = 1.0f;
+
+    // Luminance range covered by the histogram
+    float min_log_luminance = -10.0f;
+    float max_log_luminance = 4.0f;
+
+    // How fast the eye adapts, in 1/s
+    float adaptation_speed = 1.5f;
+
+    // Scene average luminance is mapped to this value
+    float key_value = 0.18f;
+};
+
+// Fullscreen exposure + tonemap + sRGB pass, with GPU auto exposure.
+// Draws to the currently bound framebuffer.
+class Tonemapper : NonMovable {
+    public:
+        Tonemapper();
+
+        // Only the viewport of hdr is used, it is upscaled to the bound framebuffer.
+        // Debug views are converted to sRGB without exposure or tonemapping.
+        void render(const Texture& hdr, const Viewport& viewport, float delta_time, bool debug_view = false);
+
+        ExposureSettings& settings();
+
+    private:
+        void update_exposure(const Texture& hdr, const glm::uvec2& size, float delta_time);
+
+        ExposureSettings _settings;
+
+        std::shared_ptr<Program> _histogram_program;
+        std::shared_ptr<Program> _exposure_program;
+        Material _tonemap_material;
+
+        TypedBuffer<shader::ExposureData> _exposure_buffer;
+};
+
+}
+
+#endif // TONEMAPPER_H
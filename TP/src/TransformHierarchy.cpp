@@ -0,0 +1,118 @@
+#include "TransformHierarchy.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+
+#ifdef SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace OM3D {
+
+glm::mat4 Transform::to_matrix() const {
+    // T * R * S, without the intermediate matrix products
+    glm::mat4 matrix = glm::mat4_cast(rotation);
+    matrix[0] *= scale.x;
+    matrix[1] *= scale.y;
+    matrix[2] *= scale.z;
+    matrix[3] = glm::vec4(translation, 1.0f);
+    return matrix;
+}
+
+glm::mat4 multiply_mat4(const glm::mat4& a, const glm::mat4& b) {
+#ifdef SIMD_SSE2
+    const __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    const __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    const __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    const __m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+    // Column i of the result is a * b[i]
+    glm::mat4 result;
+    for(int i = 0; i != 4; ++i) {
+        __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+        column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+        column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+        column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+        _mm_storeu_ps(&result[i][0], column);
+    }
+    return result;
+#else
+    return a * b;
+#endif
+}
+
+TransformHierarchy::NodeId TransformHierarchy::add_node(const Transform& local, NodeId parent) {
+    const NodeId node = NodeId(_parents.size());
+    DEBUG_ASSERT(parent == no_parent || parent < node);
+
+    _parents.push_back(parent);
+    _locals.push_back(local);
+    _worlds.emplace_back(1.0f);
+    _dirty.push_back(true);
+
+    if(!_has_dirty) {
+        _first_dirty = node;
+        _has_dirty = true;
+    }
+
+    return node;
+}
+
+void TransformHierarchy::set_local_transform(NodeId node, const Transform& local) {
+    DEBUG_ASSERT(node < _locals.size());
+    _locals[node] = local;
+    _dirty[node] = true;
+
+    _first_dirty = _has_dirty ? std::min(_first_dirty, node) : node;
+    _has_dirty = true;
+}
+
+const Transform& TransformHierarchy::local_transform(NodeId node) const {
+    return _locals[node];
+}
+
+TransformHierarchy::NodeId TransformHierarchy::parent(NodeId node) const {
+    return _parents[node];
+}
+
+size_t TransformHierarchy::node_count() const {
+    return _parents.size();
+}
+
+const glm::mat4& TransformHierarchy::world_matrix(NodeId node) const {
+    return _worlds[node];
+}
+
+Span<const TransformHierarchy::NodeId> TransformHierarchy::update() {
+    _changed.clear();
+    if(!_has_dirty) {
+        return _changed;
+    }
+
+    // Parents are before their children: a parent's dirty flag is final when its children are visited
+    const NodeId node_count = NodeId(_parents.size());
+    for(NodeId node = _first_dirty; node != node_count; ++node) {
+        const NodeId parent = _parents[node];
+        if(parent != no_parent && _dirty[parent]) {
+            _dirty[node] = true;
+        }
+
+        if(!_dirty[node]) {
+            continue;
+        }
+
+        const glm::mat4 local = _locals[node].to_matrix();
+        _worlds[node] = parent == no_parent ? local : multiply_mat4(_worlds[parent], local);
+        _changed.push_back(node);
+    }
+
+    for(const NodeId node : _changed) {
+        _dirty[node] = false;
+    }
+
+    _has_dirty = false;
+    return _changed;
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include <utils.h>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+namespace OM3D {
+
+struct Transform {
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+
+    glm::mat4 to_matrix() const;
+};
+
+// Node hierarchy stored as flat arrays where parents always come before their children,
+// so world matrices are updated in a single linear pass.
+class TransformHierarchy {
+    public:
+        using NodeId = u32;
+        static constexpr NodeId no_parent = NodeId(-1);
+
+        // The parent must already be in the hierarchy
+        NodeId add_node(const Transform& local, NodeId parent = no_parent);
+
+        void set_local_transform(NodeId node, const Transform& local);
+        const Transform& local_transform(NodeId node) const;
+
+        NodeId parent(NodeId node) const;
+        size_t node_count() const;
+
+        // Only valid after update()
+        const glm::mat4& world_matrix(NodeId node) const;
+
+        // Recompute the world matrices of the dirty nodes and their descendants.
+        // Returns the nodes whose world matrix changed, in increasing order.
+        Span<const NodeId> update();
+
+    private:
+        std::vector<NodeId> _parents;
+        std::vector<Transform> _locals;
+        std::vector<glm::mat4> _worlds;
+        std::vector<u8> _dirty;
+
+        // Nothing before this node is dirty
+        NodeId _first_dirty = 0;
+        bool _has_dirty = false;
+
+        std::vector<NodeId> _changed;
+};
+
+// a * b, using SSE when available
+glm::mat4 multiply_mat4(const glm::mat4& a, const glm::mat4& b);
+
+}
+
+#endif // TRANSFORMHIERARCHY_H
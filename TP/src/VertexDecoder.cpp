@@ -0,0 +1,225 @@
+#include "VertexDecoder.h"
+
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#ifdef SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace OM3D {
+
+u32 component_size(ComponentType type) {
+    switch(type) {
+        case ComponentType::Byte:
+        case ComponentType::UnsignedByte:
+            return 1;
+        case ComponentType::Short:
+        case ComponentType::UnsignedShort:
+            return 2;
+        case ComponentType::UnsignedInt:
+        case ComponentType::Float:
+            return 4;
+    }
+    return 0;
+}
+
+// Normalized integers follow the glTF rules: unsigned c / max, signed max(c / max, -1)
+template<typename C>
+static float read_component(const u8* data, bool normalized) {
+    C value;
+    std::memcpy(&value, data, sizeof(C));
+    if constexpr(std::is_integral_v<C>) {
+        if(normalized) {
+            return std::max(float(value) / float(std::numeric_limits<C>::max()), -1.0f);
+        }
+    }
+    return float(value);
+}
+
+template<typename C, typename T>
+static void decode_stream_as(const AttributeStream& stream, T Vertex::* attrib, bool normalize, Span<Vertex> vertices) {
+    static constexpr u32 size = u32(sizeof(T) / sizeof(float));
+    const u32 min_size = std::min(size, stream.components);
+
+    for(size_t i = 0; i != vertices.size(); ++i) {
+        const u8* data = stream.data + i * stream.stride;
+
+        T vec = vertices[i].*attrib;
+        for(u32 c = 0; c != min_size; ++c) {
+            vec[int(c)] = read_component<C>(data + c * sizeof(C), stream.normalized);
+        }
+
+        if constexpr(size >= 3) {
+            const glm::vec3 n = glm::vec3(vec);
+            const float length = glm::length(n);
+            if(normalize && length > 0.0f) {
+                for(int c = 0; c != 3; ++c) {
+                    vec[c] = n[c] / length;
+                }
+            }
+        }
+
+        vertices[i].*attrib = vec;
+    }
+}
+
+template<typename T>
+static void decode_stream(const AttributeStream& stream, T Vertex::* attrib, bool normalize, Span<Vertex> vertices) {
+    switch(stream.component_type) {
+        case ComponentType::Byte:
+            decode_stream_as<i8>(stream, attrib, normalize, vertices);
+        break;
+        case ComponentType::UnsignedByte:
+            decode_stream_as<u8>(stream, attrib, normalize, vertices);
+        break;
+        case ComponentType::Short:
+            decode_stream_as<i16>(stream, attrib, normalize, vertices);
+        break;
+        case ComponentType::UnsignedShort:
+            decode_stream_as<u16>(stream, attrib, normalize, vertices);
+        break;
+        case ComponentType::UnsignedInt:
+            decode_stream_as<u32>(stream, attrib, normalize, vertices);
+        break;
+        case ComponentType::Float:
+            decode_stream_as<float>(stream, attrib, normalize, vertices);
+        break;
+    }
+}
+
+void decode_vertices_generic(const VertexStreams& streams, Span<Vertex> vertices) {
+    if(streams.position.is_present()) {
+        decode_stream(streams.position, &Vertex::position, false, vertices);
+    }
+    if(streams.normal.is_present()) {
+        decode_stream(streams.normal, &Vertex::normal, true, vertices);
+    }
+    if(streams.uv.is_present()) {
+        decode_stream(streams.uv, &Vertex::uv, false, vertices);
+    }
+    if(streams.tangent_bitangent_sign.is_present()) {
+        decode_stream(streams.tangent_bitangent_sign, &Vertex::tangent_bitangent_sign, true, vertices);
+    }
+    if(streams.color.is_present()) {
+        decode_stream(streams.color, &Vertex::color, false, vertices);
+    }
+}
+
+
+#ifdef SIMD_SSE2
+static __m128 load_vec3(const u8* data) {
+    const __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(data)));
+    const __m128 z = _mm_load_ss(reinterpret_cast<const float*>(data) + 2);
+    return _mm_movelh_ps(xy, z);
+}
+
+static void store_vec3(float* out, __m128 v) {
+    _mm_storel_pi(reinterpret_cast<__m64*>(out), v);
+    _mm_store_ss(out + 2, _mm_movehl_ps(v, v));
+}
+
+// w must be 0
+static __m128 normalize3(__m128 v) {
+    const __m128 sq = _mm_mul_ps(v, v);
+    __m128 sum = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    // Zero vectors stay zero
+    return _mm_div_ps(v, _mm_max_ps(_mm_sqrt_ps(sum), _mm_set1_ps(1e-30f)));
+}
+#endif
+
+// Single pass over the vertices, for packed float streams
+template<bool has_normal, bool has_uv, bool has_tangent>
+static void decode_packed(const VertexStreams& streams, Span<Vertex> vertices) {
+    const AttributeStream& position = streams.position;
+    const AttributeStream& normal = streams.normal;
+    const AttributeStream& uv = streams.uv;
+    const AttributeStream& tangent = streams.tangent_bitangent_sign;
+
+#ifdef SIMD_SSE2
+    const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+#endif
+
+    for(size_t i = 0; i != vertices.size(); ++i) {
+        Vertex& vertex = vertices[i];
+
+#ifdef SIMD_SSE2
+        store_vec3(&vertex.position.x, load_vec3(position.data + i * position.stride));
+        if constexpr(has_normal) {
+            store_vec3(&vertex.normal.x, normalize3(load_vec3(normal.data + i * normal.stride)));
+        }
+        if constexpr(has_uv) {
+            _mm_storel_pi(reinterpret_cast<__m64*>(&vertex.uv.x), _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(uv.data + i * uv.stride))));
+        }
+        if constexpr(has_tangent) {
+            const __m128 t = _mm_loadu_ps(reinterpret_cast<const float*>(tangent.data + i * tangent.stride));
+            const __m128 xyz = normalize3(_mm_and_ps(t, xyz_mask));
+            _mm_storeu_ps(&vertex.tangent_bitangent_sign.x, _mm_or_ps(xyz, _mm_andnot_ps(xyz_mask, t)));
+        }
+#else
+        std::memcpy(&vertex.position, position.data + i * position.stride, sizeof(glm::vec3));
+        if constexpr(has_normal) {
+            glm::vec3 n;
+            std::memcpy(&n, normal.data + i * normal.stride, sizeof(glm::vec3));
+            const float length = glm::length(n);
+            vertex.normal = length > 0.0f ? n / length : n;
+        }
+        if constexpr(has_uv) {
+            std::memcpy(&vertex.uv, uv.data + i * uv.stride, sizeof(glm::vec2));
+        }
+        if constexpr(has_tangent) {
+            glm::vec4 t;
+            std::memcpy(&t, tangent.data + i * tangent.stride, sizeof(glm::vec4));
+            const float length = glm::length(glm::vec3(t));
+            vertex.tangent_bitangent_sign = length > 0.0f ? glm::vec4(glm::vec3(t) / length, t.w) : t;
+        }
+#endif
+    }
+}
+
+static bool is_packed_float(const AttributeStream& stream, u32 components) {
+    return stream.component_type == ComponentType::Float && stream.components == components;
+}
+
+void decode_vertices(const VertexStreams& streams, Span<Vertex> vertices) {
+    const bool has_normal = streams.normal.is_present();
+    const bool has_uv = streams.uv.is_present();
+    const bool has_tangent = streams.tangent_bitangent_sign.is_present();
+
+    const bool packed =
+        is_packed_float(streams.position, 3) &&
+        (!has_normal || is_packed_float(streams.normal, 3)) &&
+        (!has_uv || is_packed_float(streams.uv, 2)) &&
+        (!has_tangent || is_packed_float(streams.tangent_bitangent_sign, 4));
+
+    if(!streams.position.is_present() || !packed) {
+        decode_vertices_generic(streams, vertices);
+        return;
+    }
+
+    using Kernel = void (*)(const VertexStreams&, Span<Vertex>);
+    static constexpr Kernel kernels[] = {
+        decode_packed<false, false, false>,
+        decode_packed<true,  false, false>,
+        decode_packed<false, true,  false>,
+        decode_packed<true,  true,  false>,
+        decode_packed<false, false, true>,
+        decode_packed<true,  false, true>,
+        decode_packed<false, true,  true>,
+        decode_packed<true,  true,  true>,
+    };
+    kernels[u32(has_normal) | (u32(has_uv) << 1) | (u32(has_tangent) << 2)](streams, vertices);
+
+    if(streams.color.is_present()) {
+        VertexStreams colors;
+        colors.color = streams.color;
+        decode_vertices_generic(colors, vertices);
+    }
+}
+
+}
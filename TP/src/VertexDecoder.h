@@ -0,0 +1,53 @@
+#ifndef VERTEXDECODER_H
+#define VERTEXDECODER_H
+
+#include <Vertex.h>
+#include <utils.h>
+
+namespace OM3D {
+
+// glTF accessor component types
+enum class ComponentType : u32 {
+    Byte = 5120,
+    UnsignedByte = 5121,
+    Short = 5122,
+    UnsignedShort = 5123,
+    UnsignedInt = 5125,
+    Float = 5126,
+};
+
+// One attribute of every vertex, as stored in a glTF buffer
+struct AttributeStream {
+    const u8* data = nullptr;
+    size_t stride = 0;
+    u32 components = 0;
+    ComponentType component_type = ComponentType::Float;
+    // Integers are mapped to [0, 1] or [-1, 1], instead of being converted as is
+    bool normalized = false;
+
+    bool is_present() const {
+        return data;
+    }
+};
+
+struct VertexStreams {
+    AttributeStream position;
+    AttributeStream normal;
+    AttributeStream uv;
+    AttributeStream tangent_bitangent_sign;
+    AttributeStream color;
+};
+
+u32 component_size(ComponentType type);
+
+// Fills the vertices from the streams, attributes without stream are left untouched.
+// Normals and tangents are normalized.
+// Packed float positions, normals, UVs and tangents are decoded in a single pass, anything else attribute by attribute.
+void decode_vertices(const VertexStreams& streams, Span<Vertex> vertices);
+
+// Attribute by attribute, for every layout
+void decode_vertices_generic(const VertexStreams& streams, Span<Vertex> vertices);
+
+}
+
+#endif // VERTEXDECODER_H
@@ -22,4 +22,11 @@
 #define OS_LINUX
 #endif
 
+
+/****************** SIMD DEFINES BELOW ******************/
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE2
+#endif
+
 #endif // DEFINES_H
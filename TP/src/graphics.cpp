@@ -35,6 +35,12 @@ u32 buffer_usage_to_gl(BufferUsage usage) {
 
         case BufferUsage::Storage:
             return GL_SHADER_STORAGE_BUFFER;
+
+        case BufferUsage::PixelPack:
+            return GL_PIXEL_PACK_BUFFER;
+
+        case BufferUsage::PixelUnpack:
+            return GL_PIXEL_UNPACK_BUFFER;
     }
 
     FATAL("Unknown usage value");
@@ -47,6 +47,8 @@ enum class BufferUsage {
     Index,
     Uniform,
     Storage,
+    PixelPack,
+    PixelUnpack,
 };
 
 enum class AccessType {
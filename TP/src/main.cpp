@@ -10,7 +10,16 @@
 #include <SceneView.h>
 #include <Texture.h>
 #include <Framebuffer.h>
+#include <GBuffer.h>
+#include <FrameGraph.h>
+#include <Tonemapper.h>
+#include <DynamicResolution.h>
+#include <DepthPrepass.h>
+#include <TextureUploader.h>
 #include <ImGuiRenderer.h>
+#include <OcclusionRasterizer.h>
+#include <Benchmarks.h>
+#include <AllocationTracker.h>
 
 #include <imgui/imgui.h>
 
@@ -95,7 +104,8 @@ std::shared_ptr<StaticMesh> create_point_light_volume() {
     auto result = Scene::from_gltf(std::string(data_path) + "sphere.glb");
     ALWAYS_ASSERT(result.is_ok, "Unable to load sphere scene");
     scene = std::move(result.value);
-    return scene->get_object(0).get_mesh();
+    // Keeps the mesh alive after the scene is destroyed
+    return ResourcePool<StaticMesh>::global().get_shared(scene->get_object(0).mesh_handle());
 }
 
 std::unique_ptr<Scene> create_default_scene(std::shared_ptr<StaticMesh> point_light_volume) {
@@ -128,9 +138,18 @@ std::unique_ptr<Scene> create_default_scene(std::shared_ptr<StaticMesh> point_li
 }
 
 
-int main(int, char**) {
+int main(int argc, char** argv) {
     DEBUG_ASSERT([] { std::cout << "Debug asserts enabled" << std::endl; return true; }());
 
+    // CPU benchmarks: --bench <name>
+    if(argc == 3 && std::string_view(argv[1]) == "--bench") {
+        if(!run_benchmark(argv[2])) {
+            std::cerr << "Unknown benchmark: " << argv[2] << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     glfw_check(glfwInit());
     DEFER(glfwTerminate());
 
@@ -146,41 +165,62 @@ int main(int, char**) {
     glfwSwapInterval(1); // Enable vsync
     init_graphics();
 
+    Program::init_async_compilation(window);
+    DEFER(Program::shutdown_async_compilation());
+
+    const auto precompiled_programs = Material::precompile_programs();
+
     ImGuiRenderer imgui(window);
 
     std::shared_ptr<StaticMesh> point_light_volume = create_point_light_volume();
     std::unique_ptr<Scene> scene = create_default_scene(point_light_volume);
     SceneView scene_view(scene.get());
 
-    auto tonemap_program = Program::from_file("tonemap.comp");
+    Tonemapper tonemapper;
 
-    Texture lit(window_size, ImageFormat::RGBA16_FLOAT);
-    Texture color(window_size, ImageFormat::RGBA8_UNORM);
-    Framebuffer tonemap_framebuffer(nullptr, std::array{&color});
+    const GBufferLayout g_buffer_layout;
 
-    auto deferred_color = std::make_shared<Texture>(window_size, ImageFormat::RGBA8_sRGB);
-    auto deferred_normal = std::make_shared<Texture>(window_size, ImageFormat::RGBA8_UNORM);
-    auto depth = std::make_shared<Texture>(window_size, ImageFormat::Depth32_FLOAT);
+    // Not transient: the Hi-Z buffer reads it between frames
+    auto depth = std::make_shared<Texture>(window_size, g_buffer_layout.depth);
 
-    Framebuffer g_buffer(depth.get(), std::array{deferred_color.get(), deferred_normal.get()});
-    Framebuffer main_framebuffer(depth.get(), std::array{&lit});
+    DynamicResolution dynamic_resolution(window_size);
+    FrameGraph frame_graph;
 
-    Texture* debug_refs[] = { &lit, deferred_color.get(), deferred_normal.get(), depth.get() };
+    HiZBuffer hiz(depth.get());
+    bool occlusion_culling = true;
+
+    OcclusionRasterizer software_occlusion;
+    bool software_occlusion_culling = false;
+
+    DepthPrepass depth_prepass;
+
+    TextureUploader texture_uploader;
+
+    SceneLoadSettings load_settings;
+    load_settings.texture_uploader = &texture_uploader;
+    float min_pixel_radius = 1.0f;
 
     Material deferred_sun = Material::deferred_light("screen.vert", "deferred_sun.frag");
-    deferred_sun.set_texture(0u, deferred_color);
-    deferred_sun.set_texture(1u, deferred_normal);
     deferred_sun.set_depth_test_mode(DepthTestMode::Reversed);
     deferred_sun.set_write_depth(false);
 
-    Material deferred_point_light = Material::deferred_light("basic.vert", "deferred_point_light.frag");
-    deferred_point_light.set_texture(0u, deferred_color);
-    deferred_point_light.set_texture(1u, deferred_normal);
-    deferred_point_light.set_texture(2u, depth);
+    const std::array<std::string, 1> light_volume_defines = {"LIGHT_VOLUME"};
+
+    // Marks the pixels whose surface is inside the light volume
+    Material light_volume_stencil = Material::deferred_light("basic.vert", "empty.frag", light_volume_defines);
+    light_volume_stencil.set_depth_test_mode(DepthTestMode::Standard);
+    light_volume_stencil.set_write_depth(false);
+    light_volume_stencil.set_write_color(false);
+    light_volume_stencil.set_cull_mode(CullMode::None);
+    light_volume_stencil.set_stencil_mode(StencilMode::MarkVolume);
+
+    // Back faces so every pixel is shaded once, even with the camera inside the volume. The stencil replaces the depth test.
+    Material deferred_point_light = Material::deferred_light("basic.vert", "deferred_point_light.frag", light_volume_defines);
     deferred_point_light.set_blend_mode(BlendMode::Add);
-    deferred_point_light.set_depth_test_mode(DepthTestMode::Reversed);
+    deferred_point_light.set_depth_test_mode(DepthTestMode::None);
     deferred_point_light.set_write_depth(false);
     deferred_point_light.set_cull_mode(CullMode::Frontface);
+    deferred_point_light.set_stencil_mode(StencilMode::TestVolume);
 
     int debug_mode = 0;
     for(;;) {
@@ -190,39 +230,69 @@ int main(int, char**) {
         }
 
         update_delta_time();
+        begin_frame_allocations();
+        allocation_tracking_new_frame();
 
         if(const auto& io = ImGui::GetIO(); !io.WantCaptureMouse && !io.WantCaptureKeyboard) {
             process_inputs(window, scene_view.camera());
         }
 
-        {
-            g_buffer.bind();
-            scene_view.render();
-        }
-
-        {
-            main_framebuffer.bind(true, false);
-            scene_view.deferred_lighting(deferred_sun, deferred_point_light);
-        }
-
-        // Apply a tonemap in compute shader
-        {
-            tonemap_program->bind();
-            debug_refs[debug_mode]->bind(0);
-            color.bind_as_image(1, AccessType::WriteOnly);
-            glDispatchCompute(align_up_to(window_size.x, 8), align_up_to(window_size.y, 8), 1);
-        }
-
-        // Blit tonemap result to screen
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        tonemap_framebuffer.blit();
+        scene->update_transforms();
+        texture_uploader.update();
+
+        const Viewport viewport{dynamic_resolution.render_size(), window_size};
+
+        dynamic_resolution.begin_frame();
+
+        // Targets are allocated for the full window, dynamic resolution only renders to part of them
+        frame_graph.begin_frame();
+        const FrameGraph::TextureId depth_id = frame_graph.import_texture("depth", depth);
+        const FrameGraph::TextureId albedo_id = frame_graph.create_texture("albedo", {window_size, g_buffer_layout.albedo});
+        const FrameGraph::TextureId normal_id = frame_graph.create_texture("normal", {window_size, g_buffer_layout.normal});
+        const FrameGraph::TextureId lit_id = frame_graph.create_texture("lit", {window_size, g_buffer_layout.lit});
+        // Point lights sample the depth while it is attached for the stencil test: they read a copy
+        const FrameGraph::TextureId depth_copy_id = frame_graph.create_texture("depth copy", {window_size, g_buffer_layout.depth});
+
+        frame_graph.add_pass("G-buffer", [&](const FrameGraph::PassContext& pass) {
+            pass.bind_framebuffer(viewport.size);
+            CullingSettings culling;
+            culling.hiz = occlusion_culling ? &hiz : nullptr;
+            culling.software_occlusion = software_occlusion_culling ? &software_occlusion : nullptr;
+            culling.min_pixel_radius = min_pixel_radius;
+            scene_view.render(viewport, culling, &depth_prepass);
+        }).write(albedo_id).write(normal_id).write_depth(depth_id);
+
+        frame_graph.add_pass("Depth copy", [&](const FrameGraph::PassContext& pass) {
+            pass.texture(depth_id)->copy_to(*pass.texture(depth_copy_id), viewport.size);
+        }).read(depth_id).write(depth_copy_id);
+
+        frame_graph.add_pass("Lighting", [&](const FrameGraph::PassContext& pass) {
+            pass.bind_framebuffer(viewport.size, true, false);
+            deferred_sun.set_texture(0u, pass.texture(albedo_id));
+            deferred_sun.set_texture(1u, pass.texture(normal_id));
+            deferred_point_light.set_texture(0u, pass.texture(albedo_id));
+            deferred_point_light.set_texture(1u, pass.texture(normal_id));
+            deferred_point_light.set_texture(2u, pass.texture(depth_copy_id));
+            scene_view.deferred_lighting(viewport, deferred_sun, deferred_point_light, light_volume_stencil);
+        }).read(albedo_id).read(normal_id).read(depth_copy_id).read_depth(depth_id).write(lit_id);
+
+        // Exposure, tonemap and upscale, straight to the screen
+        const FrameGraph::TextureId debug_ids[] = { lit_id, albedo_id, normal_id, depth_id };
+        frame_graph.add_pass("Tonemap", [&](const FrameGraph::PassContext& pass) {
+            pass.bind_framebuffer(window_size, false, false);
+            tonemapper.render(*pass.texture(debug_ids[debug_mode]), viewport, delta_time, debug_mode != 0);
+        }).read(debug_ids[debug_mode]).write(FrameGraph::backbuffer);
+
+        frame_graph.execute();
+
+        dynamic_resolution.end_frame();
 
         // GUI
         imgui.start();
         {
             char buffer[1024] = {};
             if(ImGui::InputText("Load scene", buffer, sizeof(buffer), ImGuiInputTextFlags_EnterReturnsTrue)) {
-                auto result = Scene::from_gltf(buffer);
+                auto result = Scene::from_gltf(buffer, load_settings);
                 if(!result.is_ok) {
                     std::cerr << "Unable to load scene (" << buffer << ")" << std::endl;
                 } else {
@@ -232,6 +302,63 @@ int main(int, char**) {
                 }
             }
 
+            ImGui::Checkbox("Occlusion culling", &occlusion_culling);
+            if(occlusion_culling) {
+                bool two_phase = hiz.is_two_phase();
+                if(ImGui::Checkbox("Two-phase occlusion", &two_phase)) {
+                    hiz.set_two_phase(two_phase);
+                }
+            }
+            ImGui::Checkbox("Software occlusion culling", &software_occlusion_culling);
+
+            int lod_count = int(load_settings.lod_count);
+            if(ImGui::SliderInt("Generated LODs", &lod_count, 0, 5)) {
+                load_settings.lod_count = u32(lod_count);
+            }
+            ImGui::SliderFloat("Min pixel radius", &min_pixel_radius, 0.0f, 8.0f);
+
+            int prepass_mode = int(depth_prepass.mode());
+            if(ImGui::Combo("Depth prepass", &prepass_mode, "Auto\0Always\0Never\0")) {
+                depth_prepass.mode() = DepthPrepassMode(prepass_mode);
+            }
+            ImGui::Text("Overdraw: %.2f, depth prepass %s", depth_prepass.overdraw(), depth_prepass.is_enabled() ? "on" : "off");
+
+            DynamicResolutionSettings& resolution = dynamic_resolution.settings();
+            ImGui::Checkbox("Dynamic resolution", &resolution.enabled);
+            if(resolution.enabled) {
+                ImGui::SliderFloat("Target GPU time (ms)", &resolution.target_frame_time, 4.0f, 33.0f);
+            }
+            const FrameGraph::Stats& graph_stats = frame_graph.stats();
+            ImGui::Text("Frame graph: %u/%u passes, %u transient textures in %u textures", graph_stats.executed_pass_count, graph_stats.pass_count, graph_stats.transient_count, graph_stats.physical_texture_count);
+            ImGui::Text("GPU time: %.2fms, resolution: %ux%u (%.0f%%)", dynamic_resolution.gpu_frame_time(), viewport.size.x, viewport.size.y, dynamic_resolution.scale() * 100.0f);
+
+            if constexpr(allocation_tracking_enabled) {
+                const AllocationCounters frame_allocs = last_frame_allocations();
+                ImGui::Text("Allocations: %llu (%llu bytes) per frame", (unsigned long long)frame_allocs.count, (unsigned long long)frame_allocs.bytes);
+                for(u32 i = 0; i != allocation_scope_count(); ++i) {
+                    const AllocationCounters allocs = last_frame_scope_allocations(i);
+                    ImGui::BulletText("%s: %llu (%llu bytes)", allocation_scope_name(i), (unsigned long long)allocs.count, (unsigned long long)allocs.bytes);
+                }
+                for(u32 i = 0; i != allocation_thread_count(); ++i) {
+                    const AllocationCounters allocs = last_frame_thread_allocations(i);
+                    ImGui::BulletText("Thread %u: %llu (%llu bytes)", i, (unsigned long long)allocs.count, (unsigned long long)allocs.bytes);
+                }
+
+                int strict_mode = int(strict_allocation_mode());
+                if(ImGui::Combo("Strict allocations", &strict_mode, "Off\0Log\0Abort\0")) {
+                    set_strict_allocation_mode(StrictAllocationMode(strict_mode));
+                }
+            }
+
+            ImGui::Text("Texture uploads: %u pending, %.1f MB last frame", texture_uploader.pending_count(), double(texture_uploader.last_frame_bytes()) / (1024.0 * 1024.0));
+
+            ExposureSettings& exposure = tonemapper.settings();
+            ImGui::Checkbox("Auto exposure", &exposure.auto_exposure);
+            ImGui::SliderFloat(exposure.auto_exposure ? "Exposure compensation" : "Exposure", &exposure.exposure, 0.0f, 4.0f);
+            if(exposure.auto_exposure) {
+                ImGui::SliderFloat("Adaptation speed", &exposure.adaptation_speed, 0.1f, 10.0f);
+            }
+
             if (ImGui::BeginTable("Debug_table", 1))
             {
                 static std::vector<std::string> radio_names = { "None", "Color", "Normal", "Depth" };
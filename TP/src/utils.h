@@ -187,6 +187,15 @@ inline constexpr u32 str_hash(std::string_view str, u32 seed = 0xCAFECAFE) {
     return ~crc;
 }
 
+// 64 bits FNV-1a
+inline constexpr u64 str_hash_64(std::string_view str, u64 seed = 0xcbf29ce484222325) {
+    u64 hash = seed;
+    for(const u8 c : str) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    return hash;
+}
+
 template<typename T>
 inline constexpr T to_rad(T deg) {
     return deg * T(0.01745329251994329576923690768489);